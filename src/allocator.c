@@ -0,0 +1,76 @@
+#include "allocator.h"
+
+#include <stdlib.h>
+
+static void *default_alloc(void *ctx, size_t size) { return malloc(size); }
+
+static void *default_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    return realloc(ptr, new_size);
+}
+
+static void default_free(void *ctx, void *ptr, size_t size) { free(ptr); }
+
+Allocator default_allocator() {
+    return (Allocator){default_alloc, default_realloc, default_free, NULL};
+}
+
+static bool counting_reserve(CountingAllocator *counter, size_t size) {
+    if (counter->limit != 0 && counter->in_use + size > counter->limit) {
+        counter->limit_hit = true;
+        return false;
+    }
+    return true;
+}
+
+// size more bytes in use, allocation tells whether they came from a new block
+static void counting_record(CountingAllocator *counter, size_t size, bool allocation) {
+    counter->in_use += size;
+    counter->total += size;
+    if (allocation) counter->allocations++;
+    if (counter->in_use > counter->peak) counter->peak = counter->in_use;
+}
+
+static void *counting_alloc(void *ctx, size_t size) {
+    CountingAllocator *counter = ctx;
+    if (!counting_reserve(counter, size)) return NULL;
+
+    void *ptr = allocator_alloc(&counter->parent, size);
+    if (ptr != NULL) counting_record(counter, size, true);
+    return ptr;
+}
+
+static void *counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    CountingAllocator *counter = ctx;
+    if (new_size > old_size && !counting_reserve(counter, new_size - old_size)) return NULL;
+
+    void *grown = allocator_realloc(&counter->parent, ptr, old_size, new_size);
+    if (grown == NULL) return NULL;
+
+    // only the growth is new, the old bytes were counted when they were handed out
+    if (new_size > old_size) {
+        counting_record(counter, new_size - old_size, false);
+    } else {
+        counter->in_use -= old_size - new_size;
+    }
+    return grown;
+}
+
+static void counting_free(void *ctx, void *ptr, size_t size) {
+    CountingAllocator *counter = ctx;
+    allocator_free(&counter->parent, ptr, size);
+    counter->in_use -= size;
+}
+
+void counting_allocator_init(CountingAllocator *counter, const Allocator *parent, size_t limit) {
+    counter->parent = parent != NULL ? *parent : default_allocator();
+    counter->limit = limit;
+    counter->in_use = 0;
+    counter->peak = 0;
+    counter->total = 0;
+    counter->allocations = 0;
+    counter->limit_hit = false;
+}
+
+Allocator counting_allocator(CountingAllocator *counter) {
+    return (Allocator){counting_alloc, counting_realloc, counting_free, counter};
+}
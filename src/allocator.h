@@ -0,0 +1,59 @@
+#ifndef __ALLOCATOR_H__
+#define __ALLOCATOR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * memory interface used by the lexer, symbol table and strings
+ * every call receives ctx, and free/realloc receive the size that was requested for ptr
+ * alloc and realloc return NULL when the request cannot be served
+ */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} Allocator;
+
+typedef struct {
+    Allocator parent;
+    // 0 means no limit
+    size_t limit;
+    size_t in_use;
+    size_t peak;
+    // every byte ever handed out, including ones given back, a grown block adds its growth
+    size_t total;
+    // alloc calls served, growing a block is not a new allocation
+    size_t allocations;
+    bool limit_hit;
+} CountingAllocator;
+
+/**
+ * allocator backed by malloc/realloc/free
+ */
+Allocator default_allocator();
+
+/**
+ * sets up a counter on top of parent that fails requests going over limit bytes in use
+ * @param parent allocator doing the actual work, NULL for the default one
+ * @param limit maximum bytes in use, 0 for no limit
+ */
+void counting_allocator_init(CountingAllocator *counter, const Allocator *parent, size_t limit);
+Allocator counting_allocator(CountingAllocator *counter);
+
+static inline void *allocator_alloc(const Allocator *allocator, size_t size) {
+    return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *allocator_realloc(const Allocator *allocator, void *ptr, size_t old_size,
+                                      size_t new_size) {
+    return allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+}
+
+static inline void allocator_free(const Allocator *allocator, void *ptr, size_t size) {
+    if (ptr == NULL) return;
+    allocator->free(allocator->ctx, ptr, size);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "arena.h"
+
+#include <string.h>
+
+Arena *arena_create(const Allocator *allocator) {
+    Allocator parent = allocator != NULL ? *allocator : default_allocator();
+    Arena *arena = allocator_alloc(&parent, sizeof(Arena));
+    if (arena == NULL) return NULL;
+    arena->allocator = parent;
+    arena->head = NULL;
+    return arena;
+}
+
+void *arena_alloc(Arena *arena, size_t n) {
+    // keep every allocation pointer aligned
+    n = (n + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->capacity - block->used < n) {
+        size_t capacity = n > ARENA_BLOCK_SIZE ? n : ARENA_BLOCK_SIZE;
+        block = allocator_alloc(&arena->allocator, sizeof(ArenaBlock) + capacity);
+        if (block == NULL) return NULL;
+        block->next = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += n;
+    return ptr;
+}
+
+void arena_reset(Arena *arena) {
+    if (arena->head == NULL) return;
+    ArenaBlock *block = arena->head->next;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        allocator_free(&arena->allocator, block, sizeof(ArenaBlock) + block->capacity);
+        block = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    if (arena == NULL) return;
+    ArenaBlock *block = arena->head;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        allocator_free(&arena->allocator, block, sizeof(ArenaBlock) + block->capacity);
+        block = next;
+    }
+    Allocator parent = arena->allocator;
+    allocator_free(&parent, arena, sizeof(Arena));
+}
+
+static void *arena_allocator_alloc(void *ctx, size_t size) { return arena_alloc(ctx, size); }
+
+static void *arena_allocator_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+    if (new_size <= old_size) return ptr;
+    void *grown = arena_alloc(ctx, new_size);
+    if (grown != NULL && ptr != NULL) memcpy(grown, ptr, old_size);
+    return grown;
+}
+
+static void arena_allocator_free(void *ctx, void *ptr, size_t size) {}
+
+Allocator arena_allocator(Arena *arena) {
+    return (Allocator){arena_allocator_alloc, arena_allocator_realloc, arena_allocator_free,
+                       arena};
+}
@@ -0,0 +1,42 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+#include "allocator.h"
+
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    Allocator allocator;
+    ArenaBlock *head;
+} Arena;
+
+/**
+ * creates an empty arena
+ * @param allocator where blocks come from, NULL for the default allocator
+ */
+Arena *arena_create(const Allocator *allocator);
+/**
+ * bump allocates n bytes, memory lives until arena_free
+ */
+void *arena_alloc(Arena *arena, size_t n);
+/**
+ * gives back every allocation at once, the most recent block is kept for reuse
+ */
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+/**
+ * allocator handing out arena memory, free is a no-op
+ */
+Allocator arena_allocator(Arena *arena);
+
+#endif
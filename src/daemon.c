@@ -0,0 +1,479 @@
+#include "daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lexer.h"
+
+// flush buffered responses once they grow past this
+#define DAEMON_FLUSH_SIZE (64 * 1024)
+
+// connections with a pending request, waiting for a free worker
+typedef struct {
+    int fds[DAEMON_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    bool stopping;
+    // connection each worker is serving, -1 while idle, so that shutdown can interrupt it
+    int *active;
+    int n_workers;
+    // workers hand served connections back to the accept loop through this pipe
+    int returned;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+} RequestQueue;
+
+// per thread state, kept warm across requests
+typedef struct {
+    RequestQueue *queue;
+    int id;
+    Lexer *lexer;
+    // request payload
+    char *request;
+    size_t request_capacity;
+    // contents of the file named by a path request
+    char *source;
+    size_t source_capacity;
+    // buffered response
+    char *out;
+    size_t out_len;
+    size_t out_capacity;
+} Worker;
+
+static volatile sig_atomic_t stop_requested = 0;
+// write end of the pipe the accept loop polls, the handler uses it to wake that loop up
+static int wake_fd = -1;
+
+static void handle_stop(int signal) {
+    int saved_errno = errno;
+    stop_requested = 1;
+    // a full pipe means the loop is about to wake up anyway
+    int stop = -1;
+    if (wake_fd >= 0) write(wake_fd, &stop, sizeof(stop));
+    errno = saved_errno;
+}
+
+static bool reserve(char **buf, size_t *capacity, size_t n) {
+    if (n <= *capacity) return true;
+
+    size_t grown_capacity = *capacity > 0 ? *capacity : LEXER_BUFFER_SIZE;
+    while (grown_capacity < n) grown_capacity *= 2;
+
+    char *grown = realloc(*buf, grown_capacity);
+    if (grown == NULL) return false;
+    *buf = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t sent = write(fd, p, n);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+static bool flush(Worker *worker, int fd) {
+    bool ok = write_all(fd, worker->out, worker->out_len);
+    worker->out_len = 0;
+    return ok;
+}
+
+static bool emit(Worker *worker, int fd, const void *data, size_t n) {
+    if (!reserve(&worker->out, &worker->out_capacity, worker->out_len + n)) return false;
+    memcpy(worker->out + worker->out_len, data, n);
+    worker->out_len += n;
+    return worker->out_len < DAEMON_FLUSH_SIZE || flush(worker, fd);
+}
+
+static bool emit_u32(Worker *worker, int fd, uint32_t value) {
+    return emit(worker, fd, &value, sizeof(value));
+}
+
+// reports a request that could not be lexed at all
+static bool send_failure(Worker *worker, int fd, int error) {
+    DaemonToken record = {TOK_ERROR, error};
+    return emit(worker, fd, &record, sizeof(record)) && emit_u32(worker, fd, 0) &&
+           flush(worker, fd);
+}
+
+// reads the file named in the request into the reusable source buffer
+static bool load_file(Worker *worker, const char *path, size_t *len) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return false;
+
+    size_t n = 0;
+    size_t read;
+    do {
+        if (!reserve(&worker->source, &worker->source_capacity, n + LEXER_BUFFER_SIZE)) {
+            fclose(file);
+            errno = ENOMEM;
+            return false;
+        }
+        read = fread(worker->source + n, 1, worker->source_capacity - n, file);
+        n += read;
+    } while (read > 0);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    if (!ok) errno = EIO;
+    *len = n;
+    return ok;
+}
+
+static bool lex_request(Worker *worker, int fd, const char *name, const char *src, size_t len) {
+    Lexer *lexer = worker->lexer;
+    if (!lexer_reset(lexer, name, src, len)) {
+        return send_failure(worker, fd, errno);
+    }
+
+    while (1) {
+        Token token = get_token(lexer);
+        DaemonToken record = {token.type, token.value};
+        if (token.type == TOK_INT) {
+            record.number.i = lexer->val_int;
+        } else if (token.type == TOK_DOUBLE || token.type == TOK_SCIENTIFIC) {
+            record.number.d = lexer->val_double;
+        }
+
+        if (!emit(worker, fd, &record, sizeof(record))) return false;
+        if (token.type == TOK_EOF || token.type == TOK_ERROR) break;
+    }
+
+    if (!emit_u32(worker, fd, lexer->st->n)) return false;
+    for (size_t i = 0; i < lexer->st->n; i++) {
+        uint32_t symbol_len = st_get_len(lexer->st, i);
+        if (!emit_u32(worker, fd, symbol_len) ||
+            !emit(worker, fd, st_get(lexer->st, i), symbol_len)) {
+            return false;
+        }
+    }
+    return flush(worker, fd);
+}
+
+// answers one request, false once the connection should be closed
+static bool serve_request(Worker *worker, int fd) {
+    uint8_t kind;
+    uint32_t length;
+    if (!read_all(fd, &kind, sizeof(kind)) || !read_all(fd, &length, sizeof(length))) {
+        return false;
+    }
+
+    if ((kind != DAEMON_REQUEST_PATH && kind != DAEMON_REQUEST_BUFFER) ||
+        length > DAEMON_MAX_REQUEST) {
+        send_failure(worker, fd, EINVAL);
+        return false;
+    }
+
+    // one extra byte to terminate paths
+    if (!reserve(&worker->request, &worker->request_capacity, (size_t)length + 1)) {
+        send_failure(worker, fd, ENOMEM);
+        return false;
+    }
+    if (!read_all(fd, worker->request, length)) return false;
+
+    if (kind == DAEMON_REQUEST_PATH) {
+        worker->request[length] = '\0';
+        size_t len;
+        if (load_file(worker, worker->request, &len)) {
+            return lex_request(worker, fd, worker->request, worker->source, len);
+        }
+        return send_failure(worker, fd, errno);
+    }
+    return lex_request(worker, fd, "<inline>", worker->request, length);
+}
+
+// -1 carries no connection, it only makes the accept loop poll again, a full pipe wakes it
+// up just as well
+static void wake_accept_loop(RequestQueue *queue) {
+    int wake = -1;
+    write(queue->returned, &wake, sizeof(wake));
+}
+
+// false when the queue is full, the connection then stays with the accept loop
+static bool queue_push(RequestQueue *queue, int fd) {
+    pthread_mutex_lock(&queue->lock);
+    bool pushed = queue->count < DAEMON_QUEUE_SIZE;
+    if (pushed) {
+        queue->fds[(queue->head + queue->count) % DAEMON_QUEUE_SIZE] = fd;
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+static bool queue_has_room(RequestQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    bool room = queue->count < DAEMON_QUEUE_SIZE;
+    pthread_mutex_unlock(&queue->lock);
+    return room;
+}
+
+// returns -1 once the daemon is stopping
+static int queue_pop(RequestQueue *queue, int worker) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->stopping) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    int fd = -1;
+    if (!queue->stopping) {
+        // the accept loop stops watching clients while the queue is full
+        if (queue->count == DAEMON_QUEUE_SIZE) wake_accept_loop(queue);
+        fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % DAEMON_QUEUE_SIZE;
+        queue->count--;
+        queue->active[worker] = fd;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return fd;
+}
+
+// hands a served connection back to the accept loop, or closes it, either way the loop
+// wakes up to look at the queue again
+static void queue_done(RequestQueue *queue, int worker, int fd, bool keep) {
+    pthread_mutex_lock(&queue->lock);
+    queue->active[worker] = -1;
+    if (!keep || queue->stopping || write(queue->returned, &fd, sizeof(fd)) != sizeof(fd)) {
+        close(fd);
+        wake_accept_loop(queue);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    int fd;
+    while ((fd = queue_pop(worker->queue, worker->id)) >= 0) {
+        bool keep = serve_request(worker, fd);
+        queue_done(worker->queue, worker->id, fd, keep);
+    }
+    return NULL;
+}
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "ERROR: socket path is too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, SOMAXCONN) < 0) {
+        perror(socket_path);
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// idle connections and the two descriptors the accept loop always watches
+typedef struct {
+    struct pollfd *fds;
+    size_t n;
+    size_t capacity;
+} PollSet;
+
+static bool poll_add(PollSet *set, int fd) {
+    if (set->n == set->capacity) {
+        size_t capacity = set->capacity > 0 ? set->capacity * 2 : 16;
+        struct pollfd *grown = realloc(set->fds, sizeof(struct pollfd) * capacity);
+        if (grown == NULL) return false;
+        set->fds = grown;
+        set->capacity = capacity;
+    }
+    set->fds[set->n++] = (struct pollfd){.fd = fd, .events = POLLIN};
+    return true;
+}
+
+static void add_connection(PollSet *set, int fd) {
+    if (!poll_add(set, fd)) close(fd);
+}
+
+// a client stalling mid request or not reading its answer gives up its worker after this
+static void set_timeouts(int fd) {
+    struct timeval timeout = {.tv_sec = DAEMON_IO_TIMEOUT};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// waits for connections and requests until stopped, idle connections never hold a worker
+static void accept_loop(int listener, int returned, RequestQueue *queue, PollSet *set) {
+    set->fds[0] = (struct pollfd){.fd = returned, .events = POLLIN};
+    set->fds[1] = (struct pollfd){.fd = listener, .events = POLLIN};
+
+    while (!stop_requested) {
+        // with the queue full only wait for workers to free up
+        size_t watched = queue_has_room(queue) ? set->n : 2;
+        if (poll(set->fds, watched, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return;
+        }
+
+        // backwards so that moving the last connection into a hole skips nothing
+        for (size_t i = watched; i-- > 2;) {
+            if (set->fds[i].revents != 0 && queue_push(queue, set->fds[i].fd)) {
+                set->fds[i] = set->fds[--set->n];
+            }
+        }
+
+        if (set->fds[0].revents & POLLIN) {
+            int fd;
+            while (read(returned, &fd, sizeof(fd)) == sizeof(fd)) {
+                if (fd >= 0) add_connection(set, fd);
+            }
+        }
+
+        if (set->fds[1].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                set_timeouts(fd);
+                add_connection(set, fd);
+            } else if (errno != EINTR && errno != EAGAIN) {
+                perror("accept");
+                return;
+            }
+        }
+    }
+}
+
+int run_daemon(const char *socket_path, int threads) {
+    if (threads <= 0) threads = DAEMON_DEFAULT_THREADS;
+
+    int listener = open_listener(socket_path);
+    if (listener < 0) return 1;
+
+    // both ends non blocking: the loop drains the pipe, and a full pipe only costs a connection
+    int returned[2];
+    if (pipe(returned) < 0) {
+        perror("pipe");
+        close(listener);
+        return 1;
+    }
+    fcntl(returned[0], F_SETFL, O_NONBLOCK);
+    fcntl(returned[1], F_SETFL, O_NONBLOCK);
+    wake_fd = returned[1];
+
+    // clients hanging up mid response must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop = {.sa_handler = handle_stop};
+    sigemptyset(&stop.sa_mask);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    RequestQueue queue = {.head = 0, .count = 0, .stopping = false, .returned = returned[1]};
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    queue.active = malloc(sizeof(int) * threads);
+    PollSet set = {NULL, 0, 0};
+    bool ok = workers != NULL && ids != NULL && queue.active != NULL && poll_add(&set, -1) &&
+              poll_add(&set, -1);
+    if (!ok) fprintf(stderr, "ERROR: not enough memory\n");
+
+    int started = 0;
+    for (; ok && started < threads; started++) {
+        Worker *worker = &workers[started];
+        worker->queue = &queue;
+        worker->id = started;
+        queue.active[started] = -1;
+        worker->lexer = create_lexer_from_buffer("<inline>", "", 0, NULL);
+        if (worker->lexer == NULL ||
+            pthread_create(&ids[started], NULL, worker_main, worker) != 0) {
+            free_lexer(worker->lexer);
+            fprintf(stderr, "ERROR: could not start worker %d\n", started);
+            ok = false;
+            break;
+        }
+    }
+    queue.n_workers = started;
+
+    if (ok) {
+        fprintf(stderr, "listening on %s with %d workers\n", socket_path, started);
+        accept_loop(listener, returned[0], &queue, &set);
+    }
+
+    close(listener);
+    unlink(socket_path);
+
+    // pending requests are dropped, and connections being served are cut so that no
+    // worker stays blocked on a client
+    pthread_mutex_lock(&queue.lock);
+    queue.stopping = true;
+    for (; queue.count > 0; queue.count--) {
+        close(queue.fds[queue.head]);
+        queue.head = (queue.head + 1) % DAEMON_QUEUE_SIZE;
+    }
+    for (int i = 0; i < queue.n_workers; i++) {
+        if (queue.active[i] >= 0) shutdown(queue.active[i], SHUT_RDWR);
+    }
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+
+    for (size_t i = 2; i < set.n; i++) close(set.fds[i].fd);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+        free_lexer(workers[i].lexer);
+        free(workers[i].request);
+        free(workers[i].source);
+        free(workers[i].out);
+    }
+
+    // connections handed back after the loop stopped listening
+    int fd;
+    while (read(returned[0], &fd, sizeof(fd)) == sizeof(fd)) {
+        if (fd >= 0) close(fd);
+    }
+    wake_fd = -1;
+    close(returned[0]);
+    close(returned[1]);
+
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.not_empty);
+    free(set.fds);
+    free(queue.active);
+    free(workers);
+    free(ids);
+    return ok ? 0 : 1;
+}
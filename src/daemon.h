@@ -0,0 +1,52 @@
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <stdint.h>
+
+#define DAEMON_DEFAULT_THREADS 4
+// requests waiting for a free worker
+#define DAEMON_QUEUE_SIZE 64
+// seconds a client may stall mid request or leave its answer unread before it is dropped
+#define DAEMON_IO_TIMEOUT 10
+// largest inline source or path a client may send
+#define DAEMON_MAX_REQUEST (64 * 1024 * 1024)
+
+/*
+ * Protocol, all integers are in host byte order
+ *
+ * A client connects and sends any number of requests, each one is served by whichever
+ * worker is free so idle connections cost no thread:
+ *     uint8_t kind       DAEMON_REQUEST_PATH or DAEMON_REQUEST_BUFFER
+ *     uint32_t length
+ *     char payload[length]   file path (no terminator) or source text
+ *
+ * For every request the daemon answers with DaemonToken records, the last one being
+ * TOK_EOF or TOK_ERROR, followed by the symbol table:
+ *     uint32_t count
+ *     count times: uint32_t length, char symbol[length]
+ * Identifier and string literal tokens carry their symbol id in value.
+ * If the request itself fails (unreadable file, invalid UTF-8) the single TOK_ERROR
+ * record carries errno in value and the symbol table is empty.
+ */
+
+typedef enum { DAEMON_REQUEST_PATH = 1, DAEMON_REQUEST_BUFFER = 2 } DaemonRequestKind;
+
+typedef struct {
+    int32_t type;
+    int32_t value;
+    // TOK_INT stores val_int in i, TOK_DOUBLE/TOK_SCIENTIFIC store val_double in d
+    union {
+        int64_t i;
+        double d;
+    } number;
+} DaemonToken;
+
+/**
+ * serves lexing requests on a unix domain socket until SIGINT/SIGTERM
+ * @param socket_path where to listen, an existing socket file is replaced
+ * @param threads number of worker threads
+ * @return 0 on clean shutdown, 1 on failure
+ */
+int run_daemon(const char *socket_path, int threads);
+
+#endif
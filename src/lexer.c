@@ -1,50 +1,85 @@
 #include "lexer.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "arena.h"
 #include "string.h"
 #include "symbol_table.h"
-
-typedef struct {
-    const char *str;
-    TokenType token_class;
-} Keyword;
-
-Keyword keywords[] = {{"auto", TOK_KEYWORD_AUTO},         {"break", TOK_KEYWORD_BREAK},
-                      {"case", TOK_KEYWORD_CASE},         {"char", TOK_KEYWORD_CHAR},
-                      {"const", TOK_KEYWORD_CONST},       {"continue", TOK_KEYWORD_CONTINUE},
-                      {"default", TOK_KEYWORD_DEFAULT},   {"do", TOK_KEYWORD_DO},
-                      {"double", TOK_KEYWORD_DOUBLE},     {"else", TOK_KEYWORD_ELSE},
-                      {"enum", TOK_KEYWORD_ENUM},         {"extern", TOK_KEYWORD_EXTERN},
-                      {"float", TOK_KEYWORD_FLOAT},       {"for", TOK_KEYWORD_FOR},
-                      {"goto", TOK_KEYWORD_GOTO},         {"if", TOK_KEYWORD_IF},
-                      {"int", TOK_KEYWORD_INT},           {"long", TOK_KEYWORD_LONG},
-                      {"register", TOK_KEYWORD_REGISTER}, {"return", TOK_KEYWORD_RETURN},
-                      {"short", TOK_KEYWORD_SHORT},       {"signed", TOK_KEYWORD_SIGNED},
-                      {"sizeof", TOK_KEYWORD_SIZEOF},     {"static", TOK_KEYWORD_STATIC},
-                      {"struct", TOK_KEYWORD_STRUCT},     {"switch", TOK_KEYWORD_SWITCH},
-                      {"typedef", TOK_KEYWORD_TYPEDEF},   {"union", TOK_KEYWORD_UNION},
-                      {"unsigned", TOK_KEYWORD_UNSIGNED}, {"void", TOK_KEYWORD_VOID},
-                      {"volatile", TOK_KEYWORD_VOLATILE}, {"while", TOK_KEYWORD_WHILE}};
-
-static TokenType get_keyword_class(const char *id) {
-    if (sizeof(keywords) == 0) return TOK_ERROR;
-
-    for (int i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
-        if (strcmp(id, keywords[i].str) == 0) {
-            return keywords[i].token_class;
+#include "utf8.h"
+
+// reads the whole file into memory, returns NULL on failure
+static char *read_source(const Allocator *allocator, FILE *file, size_t *len, size_t *capacity) {
+    size_t n = 0;
+    *capacity = LEXER_BUFFER_SIZE;
+    char *buf = allocator_alloc(allocator, *capacity);
+    if (buf == NULL) return NULL;
+
+    size_t read;
+    while ((read = fread(buf + n, 1, *capacity - n, file)) > 0) {
+        n += read;
+        if (n == *capacity) {
+            char *grown = allocator_realloc(allocator, buf, *capacity, *capacity * 2);
+            if (grown == NULL) {
+                allocator_free(allocator, buf, *capacity);
+                return NULL;
+            }
+            buf = grown;
+            *capacity *= 2;
         }
     }
 
-    return TOK_ERROR;
+    if (ferror(file)) {
+        allocator_free(allocator, buf, *capacity);
+        return NULL;
+    }
+
+    *len = n;
+    return buf;
+}
+
+static Lexer *new_lexer(const Allocator *allocator) {
+    Allocator parent = allocator != NULL ? *allocator : default_allocator();
+    Lexer *lexer = allocator_alloc(&parent, sizeof(Lexer));
+    if (lexer == NULL) {
+        fprintf(stderr, "ERROR: not enough memory\n");
+        return NULL;
+    }
+
+    lexer->allocator = parent;
+    lexer->filepath = NULL;
+    lexer->src = NULL;
+    lexer->len = 0;
+    lexer->src_capacity = 0;
+    lexer->arena = arena_create(&parent);
+    lexer->st = st_create(&parent);
+    if (lexer->arena == NULL || lexer->st == NULL) {
+        fprintf(stderr, "ERROR: not enough memory\n");
+        free_lexer(lexer);
+        return NULL;
+    }
+    return lexer;
 }
 
-Lexer *create_lexer(const char *filepath) {
+// gives up the source buffer if the lexer read it in itself
+static void release_source(Lexer *lexer) {
+    if (lexer->src_capacity > 0) {
+        allocator_free(&lexer->allocator, (char *)lexer->src, lexer->src_capacity);
+    }
+    lexer->src = NULL;
+    lexer->src_capacity = 0;
+}
+
+Lexer *create_lexer(const char *filepath, const Allocator *allocator) {
     if (filepath == NULL) {
         fprintf(stderr, "ERROR: filepath is NULL\n");
         return NULL;
@@ -55,32 +90,101 @@ Lexer *create_lexer(const char *filepath) {
         return NULL;
     }
 
-    Lexer *lexer = malloc(sizeof(Lexer));
+    Lexer *lexer = new_lexer(allocator);
     if (lexer == NULL) {
-        fprintf(stderr, "ERROR: not enough memory\n");
+        fclose(file);
         return NULL;
     }
 
+    size_t len;
+    size_t capacity;
+    char *src = read_source(&lexer->allocator, file, &len, &capacity);
+    fclose(file);
+    if (src == NULL || !lexer_reset(lexer, filepath, src, len)) {
+        if (src != NULL) allocator_free(&lexer->allocator, src, capacity);
+        free_lexer(lexer);
+        return NULL;
+    }
+
+    // from here on the lexer owns src
+    lexer->src_capacity = capacity;
+    return lexer;
+}
+
+Lexer *create_lexer_from_buffer(const char *name, const char *src, size_t len,
+                                const Allocator *allocator) {
+    Lexer *lexer = new_lexer(allocator);
+    if (lexer == NULL) return NULL;
+
+    if (!lexer_reset(lexer, name, src, len)) {
+        free_lexer(lexer);
+        return NULL;
+    }
+    return lexer;
+}
+
+bool lexer_reset(Lexer *lexer, const char *name, const char *src, size_t len) {
+    size_t invalid = utf8_validate(src, len);
+    if (invalid != len) {
+        fprintf(stderr, "%s: invalid UTF-8 at byte offset %zu\n", name, invalid);
+        errno = EILSEQ;
+        return false;
+    }
+
+    release_source(lexer);
+    st_clear(lexer->st);
+    arena_reset(lexer->arena);
+
     lexer->col = 0;
     lexer->row = 1;
-    lexer->prev_col = lexer->row;
+    lexer->prev_row = lexer->row;
     lexer->prev_col = lexer->col;
     lexer->is_error = false;
-    lexer->filepath = filepath;
-    lexer->source = file;
+    lexer->filepath = name;
+    lexer->src = src;
+    lexer->len = len;
+    // a leading byte order mark is not part of the source, and takes no column
+    lexer->pos = len >= 3 && memcmp(src, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+    lexer->token_start = lexer->pos;
+    lexer->token_row = lexer->row;
+    lexer->token_col = lexer->col;
     lexer->last_char = ' ';
-    lexer->st = st_create();
-    return lexer;
+    return true;
 }
 
-static bool isdelim(uint8_t c) { return isspace(c) || c == '\t' || c == '\r' || c == '\n'; }
+LexerPosition lexer_tell(Lexer *lexer) {
+    return (LexerPosition){lexer->pos, lexer->row, lexer->col};
+}
+
+void lexer_seek(Lexer *lexer, LexerPosition position) {
+    lexer->pos = position.pos;
+    lexer->row = position.row;
+    lexer->col = position.col;
+    lexer->prev_row = lexer->row;
+    lexer->prev_col = lexer->col;
+    lexer->last_char = ' ';
+    lexer->is_error = false;
+}
+
+void free_lexer(Lexer *lexer) {
+    if (lexer == NULL) return;
+    Allocator allocator = lexer->allocator;
+    st_free(lexer->st);
+    arena_free(lexer->arena);
+    release_source(lexer);
+    allocator_free(&allocator, lexer, sizeof(Lexer));
+}
+
+static bool isdelim(int c) { return isspace(c) || c == '\t' || c == '\r' || c == '\n'; }
 
 static void next_char(Lexer *lexer) {
     lexer->prev_row = lexer->row;
     lexer->prev_col = lexer->col;
 
     lexer->col++;
-    lexer->last_char = fgetc(lexer->source);
+    // pos also moves past the end so that prev_char stays symmetric at EOF
+    lexer->last_char = lexer->pos < lexer->len ? (uint8_t)lexer->src[lexer->pos] : EOF;
+    lexer->pos++;
     if (lexer->last_char == '\n') {
         lexer->row++;
         lexer->col = 0;
@@ -89,11 +193,13 @@ static void next_char(Lexer *lexer) {
 
 // Can go back only once
 static void prev_char(Lexer *lexer) {
-    ungetc(lexer->last_char, lexer->source);
+    lexer->pos--;
     lexer->col = lexer->prev_col;
     lexer->row = lexer->prev_row;
 }
 
+#include "scanner.gen.inc"
+
 static void report_error(Lexer *lexer, const char *format, ...) {
     va_list args;
     va_start(args, format);
@@ -104,9 +210,13 @@ static void report_error(Lexer *lexer, const char *format, ...) {
 }
 
 static Token process_number(Lexer *lexer) {
-    String str = new_string();
+    String str = new_string(&lexer->allocator);
+    if (str == NULL) {
+        report_error(lexer, "not enough memory");
+        return (Token){TOK_ERROR};
+    }
     do {
-        string_append_char(str, lexer->last_char);
+        if (string_append_char(str, lexer->last_char) != 0) goto out_of_memory;
         next_char(lexer);
     } while (isdigit(lexer->last_char));
 
@@ -122,7 +232,7 @@ static Token process_number(Lexer *lexer) {
 
     // read digits after dot(.)
     do {
-        string_append_char(str, lexer->last_char);
+        if (string_append_char(str, lexer->last_char) != 0) goto out_of_memory;
         next_char(lexer);
     } while (isdigit(lexer->last_char));
 
@@ -140,7 +250,7 @@ static Token process_number(Lexer *lexer) {
     }
 
 scientific:
-    string_append_char(str, lexer->last_char);
+    if (string_append_char(str, lexer->last_char) != 0) goto out_of_memory;
     next_char(lexer);
 
     // ERROR: nothing after e
@@ -153,7 +263,7 @@ scientific:
     int digit_count = 0;
     do {
         if (isdigit(lexer->last_char)) digit_count++;
-        string_append_char(str, lexer->last_char);
+        if (string_append_char(str, lexer->last_char) != 0) goto out_of_memory;
         next_char(lexer);
     } while (isdigit(lexer->last_char));
     prev_char(lexer);
@@ -168,6 +278,221 @@ scientific:
     lexer->val_double = strtod(str->buf, NULL);
     free_string(str);
     return (Token){TOK_SCIENTIFIC};
+
+out_of_memory:
+    free_string(str);
+    report_error(lexer, "not enough memory");
+    return (Token){TOK_ERROR};
+}
+
+static Token intern(Lexer *lexer, TokenType type, const char *value, size_t len) {
+    size_t id = st_insert_n(lexer->st, value, len);
+    if (id == ST_INSERT_FAILED) {
+        report_error(lexer, "not enough memory");
+        return (Token){TOK_ERROR};
+    }
+    return (Token){type, id};
+}
+
+// index of the first quote, backslash or newline in p[0..n), n if there is none
+static size_t find_literal_stop(const char *p, size_t n, char quote) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quotes = _mm_set1_epi8(quote);
+    const __m128i backslashes = _mm_set1_epi8('\\');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quotes),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, backslashes),
+                                                 _mm_cmpeq_epi8(chunk, newlines)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == quote || p[i] == '\\' || p[i] == '\n') return i;
+    }
+    return n;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// decodes the escape sequences of raw[0..n) into out, returns the decoded length or -1
+static long decode_escapes(Lexer *lexer, const char *raw, size_t n, char *out) {
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (raw[i] != '\\') {
+            out[len++] = raw[i];
+            continue;
+        }
+
+        // the scanner guarantees a character after every backslash
+        char c = raw[++i];
+        switch (c) {
+            case 'n':
+                out[len++] = '\n';
+                break;
+            case 't':
+                out[len++] = '\t';
+                break;
+            case 'r':
+                out[len++] = '\r';
+                break;
+            case 'a':
+                out[len++] = '\a';
+                break;
+            case 'b':
+                out[len++] = '\b';
+                break;
+            case 'f':
+                out[len++] = '\f';
+                break;
+            case 'v':
+                out[len++] = '\v';
+                break;
+            case '\n':
+                // line continuation, the backslash and the newline disappear
+                break;
+            case '\\':
+            case '"':
+            case '\'':
+            case '?':
+                out[len++] = c;
+                break;
+            case 'x': {
+                int value = 0;
+                int digits = 0;
+                while (i + 1 < n && hex_value(raw[i + 1]) >= 0) {
+                    value = value * 16 + hex_value(raw[++i]);
+                    if (value > 0xFF) {
+                        report_error(lexer, "Hex escape sequence out of range");
+                        return -1;
+                    }
+                    digits++;
+                }
+                if (digits == 0) {
+                    report_error(lexer, "Expected hex digits after \\x");
+                    return -1;
+                }
+                out[len++] = (char)value;
+                break;
+            }
+            default: {
+                if (c < '0' || c > '7') {
+                    report_error(lexer, "Unknown escape sequence '\\%c'", c);
+                    return -1;
+                }
+                int value = c - '0';
+                for (int digits = 1; digits < 3 && i + 1 < n; digits++) {
+                    if (raw[i + 1] < '0' || raw[i + 1] > '7') break;
+                    value = value * 8 + (raw[++i] - '0');
+                }
+                if (value > 0xFF) {
+                    report_error(lexer, "Octal escape sequence out of range");
+                    return -1;
+                }
+                out[len++] = (char)value;
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+static Token process_string_literal(Lexer *lexer) {
+    char quote = lexer->last_char;
+    size_t start = lexer->pos;
+    size_t i = start;
+    bool has_escape = false;
+    int row = lexer->row;
+    int col = lexer->col;
+
+    // find the closing quote, only stopping at bytes that need attention
+    while (1) {
+        size_t stop = i + find_literal_stop(lexer->src + i, lexer->len - i, quote);
+        col += stop - i;
+        i = stop;
+        if (i >= lexer->len) break;
+
+        char c = lexer->src[i];
+        if (c == quote) break;
+
+        if (c == '\\') {
+            has_escape = true;
+            col++;
+            i++;
+            if (i >= lexer->len) break;
+            c = lexer->src[i];
+        }
+
+        if (c == '\n') {
+            row++;
+            col = 0;
+        } else {
+            col++;
+        }
+        i++;
+    }
+
+    if (i >= lexer->len) {
+        lexer->pos = lexer->len;
+        lexer->row = row;
+        lexer->col = col;
+        next_char(lexer);
+        report_error(lexer, "Unterminated string");
+        return (Token){TOK_ERROR};
+    }
+
+    // consume everything up to the closing quote
+    lexer->pos = i;
+    lexer->row = row;
+    lexer->col = col;
+    next_char(lexer);
+
+    const char *raw = lexer->src + start;
+    size_t n = i - start;
+
+    // fast path: the literal is exactly its source bytes
+    if (!has_escape) {
+        return intern(lexer, TOK_STRING_LITERAL, raw, n);
+    }
+
+    // decoded literals are never longer than their source
+    char *decoded = arena_alloc(lexer->arena, n);
+    if (decoded == NULL) {
+        report_error(lexer, "not enough memory");
+        return (Token){TOK_ERROR};
+    }
+
+    long len = decode_escapes(lexer, raw, n, decoded);
+    if (len < 0) {
+        return (Token){TOK_ERROR};
+    }
+
+    return intern(lexer, TOK_STRING_LITERAL, decoded, len);
+}
+
+/**
+ * number of bytes of the identifier character at last_char, 0 if it is not one
+ * @param start true for the first character of the identifier
+ */
+static int identifier_char_len(Lexer *lexer, bool start) {
+    int c = lexer->last_char;
+    if (c == EOF) return 0;
+
+    // fast path, most sources are plain ascii
+    if (c < 0x80) return isalpha(c) || c == '_' || (!start && isdigit(c));
+
+    // source was validated up front so the sequence is well formed
+    int len;
+    uint32_t cp = utf8_decode(lexer->src + lexer->pos - 1, &len);
+    return utf8_is_identifier(cp, start) ? len : 0;
 }
 
 Token get_token(Lexer *lexer) {
@@ -180,27 +505,34 @@ Token get_token(Lexer *lexer) {
     // skip delimeters
     while (isdelim(lexer->last_char)) next_char(lexer);
 
+    lexer->token_start = lexer->pos - 1;
+    lexer->token_row = lexer->row;
+    lexer->token_col = lexer->col;
+
     // identifier + keyword
-    if (isalpha(lexer->last_char) || lexer->last_char == '_') {
-        // read the whole identifier
-        String str = new_string();
+    int id_len = identifier_char_len(lexer, true);
+    if (id_len > 0) {
+        // read the whole identifier, it is interned straight from the source
+        const char *identifier = lexer->src + lexer->pos - 1;
+        size_t start = lexer->pos;
         do {
-            string_append_char(str, lexer->last_char);
+            // trailing bytes of a multibyte character
+            while (--id_len > 0) next_char(lexer);
             next_char(lexer);
-        } while (isalnum(lexer->last_char) || lexer->last_char == '_');
+        } while ((id_len = identifier_char_len(lexer, false)) > 0);
         prev_char(lexer);
-
-        // get c string
-        // basically trims the extra preallocated portion from the String
-        const char *identifier = string_c_str(str);
-        free_string(str);
+        size_t len = lexer->pos - start + 1;
 
         // check if identifier is a keyword
-        TokenType keyword_class = get_keyword_class(identifier);
+        TokenType keyword_class = keyword_lookup(identifier, len);
 
         // this identifier is not a token
         if (keyword_class == TOK_ERROR) {
-            return (Token){TOK_IDENTIFIER, st_insert(lexer->st, identifier)};
+            Token result = intern(lexer, TOK_IDENTIFIER, identifier, len);
+            if (result.type == TOK_ERROR) {
+                lexer->is_error = true;
+            }
+            return result;
         }
 
         // this identifier is a keyword
@@ -211,13 +543,11 @@ Token get_token(Lexer *lexer) {
     if (isdigit(lexer->last_char) || lexer->last_char == '.') {
         bool parse_number = true;
         if (lexer->last_char == '.') {
-            // TODO: fgetc shouldn't be called directly
-            char c = fgetc(lexer->source);
+            int c = lexer->pos < lexer->len ? (uint8_t)lexer->src[lexer->pos] : EOF;
             // this means this is just a dot
             if (!isdigit(c)) {
                 parse_number = false;
             }
-            ungetc(c, lexer->source);
         }
         if (parse_number) {
             Token result = process_number(lexer);
@@ -230,134 +560,26 @@ Token get_token(Lexer *lexer) {
 
     // String literal
     if (lexer->last_char == '"' || lexer->last_char == '\'') {
-        char string_literal_start = lexer->last_char;
-        String str = new_string();
-        next_char(lexer);
-        while (lexer->last_char != EOF && lexer->last_char != string_literal_start) {
-            string_append_char(str, lexer->last_char);
-            next_char(lexer);
-        }
-
-        if (lexer->last_char != string_literal_start) {
-            report_error(lexer, "Unterminated string");
+        Token result = process_string_literal(lexer);
+        if (result.type == TOK_ERROR) {
             lexer->is_error = true;
-            return (Token){TOK_ERROR};
         }
-
-        const char *s = string_c_str(str);
-        free_string(str);
-
-        return (Token){TOK_STRING_LITERAL, st_insert(lexer->st, s)};
+        return result;
     }
 
-    switch (lexer->last_char) {
-        case '>': {
-            next_char(lexer);
-            if (lexer->last_char == '=') {
-                return (Token){TOK_RELOP, RELOP_GE};
-            }
-            prev_char(lexer);
-            return (Token){TOK_RELOP, RELOP_GT};
-        }
-        case '<': {
-            next_char(lexer);
-            if (lexer->last_char == '=') {
-                return (Token){TOK_RELOP, RELOP_LE};
-            } else if (lexer->last_char == '>') {
-                return (Token){TOK_RELOP, RELOP_NE};
-            }
-            prev_char(lexer);
-            return (Token){TOK_RELOP, RELOP_LT};
-        }
-        case '=': {
-            next_char(lexer);
-            if (lexer->last_char == '=') {
-                return (Token){TOK_RELOP, RELOP_EQ};
-            }
-            prev_char(lexer);
-            return (Token){TOK_EQUAL};
-        }
-        case '+': {
-            next_char(lexer);
-            if (lexer->last_char == '+') {
-                return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_DOUBLE_PLUS};
-            }
-            prev_char(lexer);
-            return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_PLUS};
-        }
-        case '-': {
-            next_char(lexer);
-            if (lexer->last_char == '-') {
-                return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_DOUBLE_MINUS};
-            }
-            prev_char(lexer);
-            return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_MINUS};
-        }
-        case '/': {
-            next_char(lexer);
-            // comment
-            if (lexer->last_char == '/') {
-                do {
-                    next_char(lexer);
-                } while (lexer->last_char != '\n' && lexer->last_char != EOF);
-                return get_token(lexer);
-            }
-            prev_char(lexer);
-            return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_DIV};
-        }
-        case '*': {
-            next_char(lexer);
-            if (lexer->last_char == '*') {
-                return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_EXP};
-            }
-            prev_char(lexer);
-            return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_MUL};
-        }
-        case '%':
-            return (Token){TOK_ARITHMETIC_OPERATOR, A_OP_MOD};
-        case '(':
-            return (Token){TOK_L_PARAN};
-        case ')':
-            return (Token){TOK_R_PARAN};
-        case '[':
-            return (Token){TOK_L_SQUARE_BRACKET};
-        case ']':
-            return (Token){TOK_R_SQUARE_BRACKET};
-        case '{':
-            return (Token){TOK_L_BRACE};
-        case '}':
-            return (Token){TOK_R_BRACE};
-        case '&': {
-            next_char(lexer);
-            if (lexer->last_char == '&') {
-                return (Token){TOK_LOGICAL_OPERATOR, L_OP_AND};
-            }
-            prev_char(lexer);
-            break;
-        }
-        case '|': {
-            next_char(lexer);
-            if (lexer->last_char == '|') {
-                return (Token){TOK_LOGICAL_OPERATOR, L_OP_OR};
-            }
-            prev_char(lexer);
-            break;
-        }
-        case '!':
-            return (Token){TOK_LOGICAL_OPERATOR, L_OP_NOT};
-        case ';':
-            return (Token){TOK_SEMI_COLON};
-        case ':':
-            return (Token){TOK_COLON};
-        case ',':
-            return (Token){TOK_COMMA};
-        case '.':
-            return (Token){TOK_DOT};
-        case EOF:
-            return (Token){TOK_EOF};
+    // operators, symbols, comments and EOF
+    Token result = scan_operator(lexer);
+    if (result.type != TOK_ERROR || lexer->is_error) {
+        return result;
     }
 
     lexer->is_error = true;
-    report_error(lexer, "Unrecognised token '%c'", lexer->last_char);
+    if (lexer->last_char >= 0x80) {
+        int len;
+        report_error(lexer, "Unrecognised character U+%04X",
+                     utf8_decode(lexer->src + lexer->pos - 1, &len));
+    } else {
+        report_error(lexer, "Unrecognised token '%c'", lexer->last_char);
+    }
     return (Token){TOK_ERROR};
 }
@@ -6,126 +6,85 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "allocator.h"
+#include "arena.h"
 #include "symbol_table.h"
+// TokenType and the operator value enums, generated from tokens.spec
+#include "tokens.gen.h"
 
 #define LEXER_BUFFER_SIZE 4096
 
 typedef struct {
     const char *filepath;
-    FILE *source;
+    // every allocation the lexer, its symbol table and strings make goes through here
+    Allocator allocator;
+    // whole source file, string literals without escapes are interned straight from here
+    const char *src;
+    size_t len;
+    // non zero when the lexer read src in itself and has to free it
+    size_t src_capacity;
+    size_t pos;
+    // backing memory for string literals that needed escape decoding
+    Arena *arena;
     ST *st;
     int row;
     int col;
     int prev_row;
     int prev_col;
-    char last_char;
+    // current byte as an unsigned char, or EOF
+    int last_char;
+    // where the token last returned by get_token starts
+    size_t token_start;
+    int token_row;
+    int token_col;
     bool is_error;
     // for both scientific and double/float values
     double val_double;
     int val_int;
 } Lexer;
 
-typedef enum {
-    TOK_ERROR = -1,
-
-    // identifier
-    TOK_IDENTIFIER,
-
-    // numbers
-    TOK_INT,
-    TOK_DOUBLE,
-    TOK_SCIENTIFIC,
-
-    // operators
-    TOK_RELOP,
-
-    // End of file
-    TOK_EOF,
-
-    // keywords
-    TOK_KEYWORD_AUTO,
-    TOK_KEYWORD_BREAK,
-    TOK_KEYWORD_CASE,
-    TOK_KEYWORD_CHAR,
-    TOK_KEYWORD_CONST,
-    TOK_KEYWORD_CONTINUE,
-    TOK_KEYWORD_DEFAULT,
-    TOK_KEYWORD_DO,
-    TOK_KEYWORD_DOUBLE,
-    TOK_KEYWORD_ELSE,
-    TOK_KEYWORD_ENUM,
-    TOK_KEYWORD_EXTERN,
-    TOK_KEYWORD_FLOAT,
-    TOK_KEYWORD_FOR,
-    TOK_KEYWORD_GOTO,
-    TOK_KEYWORD_IF,
-    TOK_KEYWORD_INT,
-    TOK_KEYWORD_LONG,
-    TOK_KEYWORD_REGISTER,
-    TOK_KEYWORD_RETURN,
-    TOK_KEYWORD_SHORT,
-    TOK_KEYWORD_SIGNED,
-    TOK_KEYWORD_SIZEOF,
-    TOK_KEYWORD_STATIC,
-    TOK_KEYWORD_STRUCT,
-    TOK_KEYWORD_SWITCH,
-    TOK_KEYWORD_TYPEDEF,
-    TOK_KEYWORD_UNION,
-    TOK_KEYWORD_UNSIGNED,
-    TOK_KEYWORD_VOID,
-    TOK_KEYWORD_VOLATILE,
-    TOK_KEYWORD_WHILE,
-
-    // Literals
-    TOK_STRING_LITERAL,
-
-    // Symbols
-    TOK_R_BRACE,
-    TOK_L_BRACE,
-    TOK_R_PARAN,
-    TOK_L_PARAN,
-    TOK_R_SQUARE_BRACKET,
-    TOK_L_SQUARE_BRACKET,
-    TOK_R_ANGLE_BRACKET,
-    TOK_L_ANGLE_BRACKET,
-
-    // Operators
-    TOK_ARITHMETIC_OPERATOR,
-    TOK_LOGICAL_OPERATOR,
-
-    // Misc
-    TOK_EQUAL,
-    TOK_SEMI_COLON,
-    TOK_COLON,
-    TOK_COMMA,
-    TOK_DOT
-} TokenType;
-
-typedef enum { RELOP_LT, RELOP_GT, RELOP_EQ, RELOP_LE, RELOP_GE, RELOP_NE } RelOp;
-
-typedef enum {
-    A_OP_PLUS,
-    A_OP_MINUS,
-    A_OP_DIV,
-    A_OP_MUL,
-    A_OP_EXP,
-    A_OP_MOD,
-    A_OP_DOUBLE_PLUS,
-    A_OP_DOUBLE_MINUS
-} ArithmeticOperator;
-
-typedef enum { L_OP_AND, L_OP_OR, L_OP_NOT } LogicalOperator;
-
 typedef struct {
     TokenType type;
     int value;
 } Token;
 
+/**
+ * spot between two tokens the lexer can be rewound to
+ * tokens never span a position, so no literal or comment state is needed
+ */
+typedef struct {
+    size_t pos;
+    int row;
+    int col;
+} LexerPosition;
+
 /**
  * creates a new lexer context
  * @param filepath input source file
+ * @param allocator memory for the lexer and everything it creates, NULL for the default allocator
+ */
+Lexer *create_lexer(const char *filepath, const Allocator *allocator);
+/**
+ * creates a lexer over an in memory source, src is borrowed and must outlive the lexer
+ * @param name used in error messages
+ */
+Lexer *create_lexer_from_buffer(const char *name, const char *src, size_t len,
+                                const Allocator *allocator);
+/**
+ * rewinds the lexer onto a new borrowed source, keeping its symbol table and arena memory
+ * symbols from the previous source are dropped
+ * @return false if src is not valid UTF-8, the lexer is left untouched
+ */
+bool lexer_reset(Lexer *lexer, const char *name, const char *src, size_t len);
+void free_lexer(Lexer *lexer);
+/**
+ * position right after the last token, only meaningful between get_token calls
+ */
+LexerPosition lexer_tell(Lexer *lexer);
+/**
+ * moves the lexer to a position previously returned by lexer_tell, clearing any error
  */
-Lexer *create_lexer(const char *filepath);
+void lexer_seek(Lexer *lexer, LexerPosition position);
 Token get_token(Lexer *lexer);
 
 #endif
\ No newline at end of file
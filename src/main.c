@@ -1,189 +1,197 @@
 #include <errno.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "daemon.h"
 #include "lexer.h"
+#include "token_index.h"
+#include "watch.h"
 
-const char *tok_to_str(TokenType tok) {
-    switch (tok) {
-        case TOK_IDENTIFIER:
-            return "TOK_IDENTIFIER";
-        case TOK_INT:
-            return "TOK_INT";
-        case TOK_DOUBLE:
-            return "TOK_DOUBLE";
-        case TOK_SCIENTIFIC:
-            return "TOK_SCIENTIFIC";
-        case TOK_RELOP:
-            return "TOK_RELOP";
-        case TOK_KEYWORD_AUTO:
-            return "TOK_KEYWORD_AUTO";
-        case TOK_KEYWORD_BREAK:
-            return "TOK_KEYWORD_BREAK";
-        case TOK_KEYWORD_CASE:
-            return "TOK_KEYWORD_CASE";
-        case TOK_KEYWORD_CHAR:
-            return "TOK_KEYWORD_CHAR";
-        case TOK_KEYWORD_CONST:
-            return "TOK_KEYWORD_CONST";
-        case TOK_KEYWORD_CONTINUE:
-            return "TOK_KEYWORD_CONTINUE";
-        case TOK_KEYWORD_DEFAULT:
-            return "TOK_KEYWORD_DEFAULT";
-        case TOK_KEYWORD_DO:
-            return "TOK_KEYWORD_DO";
-        case TOK_KEYWORD_DOUBLE:
-            return "TOK_KEYWORD_DOUBLE";
-        case TOK_KEYWORD_ELSE:
-            return "TOK_KEYWORD_ELSE";
-        case TOK_KEYWORD_ENUM:
-            return "TOK_KEYWORD_ENUM";
-        case TOK_KEYWORD_EXTERN:
-            return "TOK_KEYWORD_EXTERN";
-        case TOK_KEYWORD_FLOAT:
-            return "TOK_KEYWORD_FLOAT";
-        case TOK_KEYWORD_FOR:
-            return "TOK_KEYWORD_FOR";
-        case TOK_KEYWORD_GOTO:
-            return "TOK_KEYWORD_GOTO";
-        case TOK_KEYWORD_IF:
-            return "TOK_KEYWORD_IF";
-        case TOK_KEYWORD_INT:
-            return "TOK_KEYWORD_INT";
-        case TOK_KEYWORD_LONG:
-            return "TOK_KEYWORD_LONG";
-        case TOK_KEYWORD_REGISTER:
-            return "TOK_KEYWORD_REGISTER";
-        case TOK_KEYWORD_RETURN:
-            return "TOK_KEYWORD_RETURN";
-        case TOK_KEYWORD_SHORT:
-            return "TOK_KEYWORD_SHORT";
-        case TOK_KEYWORD_SIGNED:
-            return "TOK_KEYWORD_SIGNED";
-        case TOK_KEYWORD_SIZEOF:
-            return "TOK_KEYWORD_SIZEOF";
-        case TOK_KEYWORD_STATIC:
-            return "TOK_KEYWORD_STATIC";
-        case TOK_KEYWORD_STRUCT:
-            return "TOK_KEYWORD_STRUCT";
-        case TOK_KEYWORD_SWITCH:
-            return "TOK_KEYWORD_SWITCH";
-        case TOK_KEYWORD_TYPEDEF:
-            return "TOK_KEYWORD_TYPEDEF";
-        case TOK_KEYWORD_UNION:
-            return "TOK_KEYWORD_UNION";
-        case TOK_KEYWORD_UNSIGNED:
-            return "TOK_KEYWORD_UNSIGNED";
-        case TOK_KEYWORD_VOID:
-            return "TOK_KEYWORD_VOID";
-        case TOK_KEYWORD_VOLATILE:
-            return "TOK_KEYWORD_VOLATILE";
-        case TOK_KEYWORD_WHILE:
-            return "TOK_KEYWORD_WHILE";
-        case TOK_STRING_LITERAL:
-            return "TOK_STRING_LITERAL";
-        case TOK_ARITHMETIC_OPERATOR:
-            return "TOK_ARITHMETIC_OPERATOR";
-        case TOK_R_BRACE:
-            return "TOK_R_BRACE";
-        case TOK_L_BRACE:
-            return "TOK_L_BRACE";
-        case TOK_R_PARAN:
-            return "TOK_R_PARAN";
-        case TOK_L_PARAN:
-            return "TOK_L_PARAN";
-        case TOK_R_SQUARE_BRACKET:
-            return "TOK_R_SQUARE_BRACKET";
-        case TOK_L_SQUARE_BRACKET:
-            return "TOK_L_SQUARE_BRACKET";
-        case TOK_R_ANGLE_BRACKET:
-            return "TOK_R_ANGLE_BRACKET";
-        case TOK_L_ANGLE_BRACKET:
-            return "TOK_L_ANGLE_BRACKET";
-        case TOK_LOGICAL_OPERATOR:
-            return "TOK_LOGICAL_OPERATOR";
-        case TOK_EQUAL:
-            return "TOK_EQUAL";
-        case TOK_SEMI_COLON:
-            return "TOK_SEMI_COLON";
-        case TOK_COLON:
-            return "TOK_COLON";
-        case TOK_COMMA:
-            return "TOK_COMMA";
-        case TOK_DOT:
-            return "TOK_DOT";
-        default:
-            return "<unknown>";
+static void print_token(Lexer *lexer, Token token) {
+    printf("%s", tok_to_str(token.type));
+
+    if (token.type == TOK_IDENTIFIER || token.type == TOK_STRING_LITERAL) {
+        printf(": (%d) %.*s", token.value, (int)st_get_len(lexer->st, token.value),
+               st_get(lexer->st, token.value));
+    }
+
+    if (token.type == TOK_INT) {
+        printf(": %d", lexer->val_int);
+    }
+
+    if (token.type == TOK_DOUBLE || token.type == TOK_SCIENTIFIC) {
+        printf(": %lf", lexer->val_double);
+    }
+
+    if (token.type == TOK_RELOP) {
+        printf(": %s", relop_to_str(token.value));
+    }
+
+    if (token.type == TOK_ARITHMETIC_OPERATOR) {
+        printf(": %s", arithmetic_op_to_str(token.value));
     }
-}
 
-const char *arithmetic_op_to_str(ArithmeticOperator op) {
-    switch (op) {
-        case A_OP_PLUS:
-            return "A_OP_PLUS";
-        case A_OP_MINUS:
-            return "A_OP_MINUS";
-        case A_OP_DIV:
-            return "A_OP_DIV";
-        case A_OP_MUL:
-            return "A_OP_MUL";
-        case A_OP_EXP:
-            return "A_OP_EXP";
-        case A_OP_MOD:
-            return "A_OP_MOD";
-        case A_OP_DOUBLE_PLUS:
-            return "A_OP_DOUBLE_PLUS";
-        case A_OP_DOUBLE_MINUS:
-            return "A_OP_DOUBLE_MINUS";
-        default:
-            return "<unknown>";
+    if (token.type == TOK_LOGICAL_OPERATOR) {
+        printf(": %s", logical_op_to_str(token.value));
     }
+
+    printf("\n");
 }
 
-const char *logical_op_to_str(LogicalOperator op) {
-    switch (op) {
-        case L_OP_AND:
-            return "L_OP_AND";
-        case L_OP_OR:
-            return "L_OP_OR";
-        case L_OP_NOT:
-            return "L_OP_NOT";
-        default:
-            return "<unknown>";
+// prints count tokens starting at token number first, or up to byte offset end when count is 0
+static int print_tokens(Lexer *lexer, size_t first, size_t count, size_t end) {
+    for (size_t n = first; count == 0 || n < first + count; n++) {
+        Token token = get_token(lexer);
+        if (token.type == TOK_EOF || (count == 0 && lexer->token_start >= end)) break;
+        if (token.type == TOK_ERROR) {
+            fprintf(stderr, "ERROR: lexer failed\n");
+            return 1;
+        }
+        printf("%zu %d:%d ", n, lexer->token_row, lexer->token_col);
+        print_token(lexer, token);
     }
+    return 0;
 }
 
-const char *relop_to_str(RelOp relop) {
-    switch (relop) {
-        case RELOP_LT:
-            return "RELOP_LT";
-        case RELOP_LE:
-            return "RELOP_LE";
-        case RELOP_EQ:
-            return "RELOP_EQ";
-        case RELOP_GE:
-            return "RELOP_GE";
-        case RELOP_GT:
-            return "RELOP_GT";
-        case RELOP_NE:
-            return "RELOP_NE";
-        default:
-            return "<unknown>";
+// answers --token / --range from <sourcefile>.idx, building and saving it when missing or stale
+static int query_index(Lexer *lexer, const char *sourcefile, size_t every_bytes, bool rebuild,
+                       long token, size_t range_start, size_t range_end) {
+    char *index_path = malloc(strlen(sourcefile) + sizeof(TOKEN_INDEX_EXTENSION));
+    if (index_path == NULL) {
+        fprintf(stderr, "ERROR: not enough memory\n");
+        return 1;
+    }
+    strcpy(index_path, sourcefile);
+    strcat(index_path, TOKEN_INDEX_EXTENSION);
+
+    TokenIndex *index = rebuild ? NULL : token_index_load(index_path, lexer);
+    if (index == NULL) {
+        index = token_index_build(lexer, every_bytes, 0);
+        if (index == NULL) {
+            fprintf(stderr, "ERROR: could not index %s\n", sourcefile);
+            free(index_path);
+            return 1;
+        }
+        if (!token_index_save(index, index_path)) {
+            fprintf(stderr, "%s: %s\n", index_path, strerror(errno));
+        } else {
+            fprintf(stderr, "%s: %zu checkpoints over %llu tokens\n", index_path,
+                    index->n_checkpoints, (unsigned long long)index->token_count);
+        }
+    }
+
+    int result = 0;
+    if (token >= 0) {
+        if (!token_index_seek_token(index, lexer, token)) {
+            fprintf(stderr, "ERROR: no token #%ld\n", token);
+            result = 1;
+        } else {
+            result = print_tokens(lexer, token, 1, 0);
+        }
+    } else if (range_end > range_start) {
+        size_t first;
+        if (!token_index_seek_offset(index, lexer, range_start, &first)) {
+            fprintf(stderr, "ERROR: lexer failed\n");
+            result = 1;
+        } else {
+            result = print_tokens(lexer, first, 0, range_end);
+        }
     }
+
+    token_index_free(index);
+    free(index_path);
+    return result;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "usage: %s [--mem-stats] [--mem-limit bytes] sourcefile\n", program);
+    fprintf(stderr, "       %s --daemon socket [--threads n]\n", program);
+    fprintf(stderr, "       %s --watch dir\n", program);
+    fprintf(stderr,
+            "       %s [--index] [--index-every bytes] [--token n | --range from:to] sourcefile\n",
+            program);
 }
 
 int main(int argc, const char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "usage: %s sourcefile\n", argv[0]);
+    const char *sourcefile = NULL;
+    bool mem_stats = false;
+    size_t mem_limit = 0;
+    const char *socket_path = NULL;
+    int threads = DAEMON_DEFAULT_THREADS;
+    const char *watch_dir = NULL;
+    bool build_index = false;
+    size_t index_every = TOKEN_INDEX_DEFAULT_BYTES;
+    long token_query = -1;
+    size_t range_start = 0;
+    size_t range_end = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--index") == 0) {
+            build_index = true;
+        } else if (strcmp(argv[i], "--index-every") == 0 && i + 1 < argc) {
+            index_every = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--token") == 0 && i + 1 < argc) {
+            token_query = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--range") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%zu:%zu", &range_start, &range_end) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watch_dir = argv[++i];
+        } else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            mem_stats = true;
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            mem_limit = strtoull(argv[++i], NULL, 10);
+        } else if (sourcefile == NULL) {
+            sourcefile = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (socket_path != NULL) {
+        return run_daemon(socket_path, threads);
+    }
+
+    if (watch_dir != NULL) {
+        return run_watch(watch_dir);
+    }
+
+    if (sourcefile == NULL) {
+        usage(argv[0]);
         return 1;
     }
 
-    Lexer *lexer = create_lexer(argv[1]);
+    CountingAllocator counter;
+    counting_allocator_init(&counter, NULL, mem_limit);
+    Allocator allocator = counting_allocator(&counter);
+
+    Lexer *lexer = create_lexer(sourcefile, &allocator);
     if (lexer == NULL) {
-        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        if (counter.limit_hit) {
+            fprintf(stderr, "%s: memory limit of %zu bytes exceeded\n", sourcefile, mem_limit);
+        } else {
+            fprintf(stderr, "%s: %s\n", sourcefile, strerror(errno));
+        }
         return 1;
     }
 
+    if (build_index || token_query >= 0 || range_end > range_start) {
+        int result = query_index(lexer, sourcefile, index_every, build_index, token_query,
+                                 range_start, range_end);
+        free_lexer(lexer);
+        return result;
+    }
+
+    size_t token_count = 0;
     while (1) {
         Token token = get_token(lexer);
         if (token.type == TOK_EOF) {
@@ -192,39 +200,26 @@ int main(int argc, const char *argv[]) {
 
         if (token.type == TOK_ERROR) {
             fprintf(stderr, "ERROR: lexer failed\n");
+            free_lexer(lexer);
             return 1;
         }
+        token_count++;
 
-        printf("%s", tok_to_str(token.type));
-
-        if (token.type == TOK_IDENTIFIER || token.type == TOK_STRING_LITERAL) {
-            printf(": (%d) %s", token.value, st_get(lexer->st, token.value));
-        }
-
-        if (token.type == TOK_INT) {
-            printf(": %d", lexer->val_int);
-        }
-
-        if (token.type == TOK_DOUBLE || token.type == TOK_SCIENTIFIC) {
-            printf(": %lf", lexer->val_double);
-        }
-
-        if (token.type == TOK_RELOP) {
-            printf(": %s", relop_to_str(token.value));
-        }
+        print_token(lexer, token);
+    }
 
-        if (token.type == TOK_ARITHMETIC_OPERATOR) {
-            printf(": %s", arithmetic_op_to_str(token.value));
-        }
+    printf("Lexer finished\n");
 
-        if (token.type == TOK_LOGICAL_OPERATOR) {
-            printf(": %s", logical_op_to_str(token.value));
+    if (mem_stats) {
+        fprintf(stderr, "tokens: %zu\n", token_count);
+        fprintf(stderr, "bytes allocated: %zu in %zu allocations, peak %zu\n", counter.total,
+                counter.allocations, counter.peak);
+        if (token_count > 0) {
+            fprintf(stderr, "bytes per token: %.2f\n", (double)counter.total / token_count);
         }
-
-        printf("\n");
     }
 
-    printf("Lexer finished\n");
+    free_lexer(lexer);
 
     return 0;
 }
\ No newline at end of file
@@ -1,20 +1,28 @@
 #include "string.h"
 
-#include <stdlib.h>
 #include <string.h>
 
-String new_string() {
-    String str = malloc(sizeof(string_t));
-    str->buf = malloc(sizeof(char) * (INITIAL_STRING_CAPACITY + 1));
+String new_string(const Allocator *allocator) {
+    Allocator parent = allocator != NULL ? *allocator : default_allocator();
+    String str = allocator_alloc(&parent, sizeof(string_t));
+    if (str == NULL) return NULL;
+    str->buf = allocator_alloc(&parent, sizeof(char) * (INITIAL_STRING_CAPACITY + 1));
+    if (str->buf == NULL) {
+        allocator_free(&parent, str, sizeof(string_t));
+        return NULL;
+    }
+    str->allocator = parent;
     str->capacity = INITIAL_STRING_CAPACITY;
     str->n = 0;
     return str;
 }
 int string_append_char(String str, char c) {
     if (str->n == str->capacity) {
+        char *buf = allocator_realloc(&str->allocator, str->buf, sizeof(char) * (str->capacity + 1),
+                                      sizeof(char) * (str->capacity + 128 + 1));
+        if (buf == NULL) return 1;
+        str->buf = buf;
         str->capacity += 128;
-        str->buf = realloc(str->buf, sizeof(char) * (str->capacity + 1));
-        if (str->buf == NULL) return 1;
     }
 
     str->buf[str->n++] = c;
@@ -23,10 +31,14 @@ int string_append_char(String str, char c) {
 }
 void free_string(String str) {
     if (str == NULL) return;
-    free(str->buf);
-    free(str);
+    Allocator allocator = str->allocator;
+    allocator_free(&allocator, str->buf, sizeof(char) * (str->capacity + 1));
+    allocator_free(&allocator, str, sizeof(string_t));
 }
 char *string_c_str(String str) {
     if (str == NULL) return NULL;
-    return strndup(str->buf, str->n);
-}
\ No newline at end of file
+    char *s = allocator_alloc(&str->allocator, str->n + 1);
+    if (s == NULL) return NULL;
+    memcpy(s, str->buf, str->n + 1);
+    return s;
+}
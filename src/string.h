@@ -4,9 +4,12 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "allocator.h"
+
 #define INITIAL_STRING_CAPACITY 128
 
 typedef struct {
+    Allocator allocator;
     char *buf;
     size_t n;
     size_t capacity;
@@ -14,9 +17,16 @@ typedef struct {
 
 typedef string_t *String;
 
-String new_string();
+/**
+ * @param allocator NULL for the default allocator
+ * @return NULL when out of memory
+ */
+String new_string(const Allocator *allocator);
 int string_append_char(String str, char c);
 void free_string(String str);
+/**
+ * copies the string out with its own allocator, release with allocator_free(.., n + 1)
+ */
 char *string_c_str(String str);
 
-#endif
\ No newline at end of file
+#endif
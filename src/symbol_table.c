@@ -1,32 +1,133 @@
 #include "symbol_table.h"
 
-#include <stdlib.h>
 #include <string.h>
 
-ST *st_create() {
-    ST *st = malloc(sizeof(ST));
-    st->entries = malloc(sizeof(char *) * ST_INITIAL_CAPACITY);
+static size_t hash_symbol(const char *value, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)value[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// bucket holding id + 1 for value, or the empty bucket it would go in
+static size_t *find_bucket(ST *st, const char *value, size_t len) {
+    size_t mask = st->n_buckets - 1;
+    for (size_t i = hash_symbol(value, len) & mask;; i = (i + 1) & mask) {
+        size_t id = st->buckets[i];
+        if (id == 0) return &st->buckets[i];
+        const STEntry *entry = &st->entries[id - 1];
+        if (entry->len == len && memcmp(entry->str, value, len) == 0) return &st->buckets[i];
+    }
+}
+
+// sizes the buckets for n entries and indexes the current ones
+static bool rehash(ST *st, size_t n) {
+    size_t n_buckets = st->n_buckets;
+    while (n * 2 > n_buckets) n_buckets *= 2;
+
+    if (n_buckets != st->n_buckets) {
+        size_t *buckets = allocator_realloc(&st->allocator, st->buckets,
+                                            sizeof(size_t) * st->n_buckets,
+                                            sizeof(size_t) * n_buckets);
+        if (buckets == NULL) return false;
+        st->buckets = buckets;
+        st->n_buckets = n_buckets;
+    }
+
+    memset(st->buckets, 0, sizeof(size_t) * st->n_buckets);
+    for (size_t i = 0; i < st->n; i++) {
+        *find_bucket(st, st->entries[i].str, st->entries[i].len) = i + 1;
+    }
+    return true;
+}
+
+ST *st_create(const Allocator *allocator) {
+    Allocator parent = allocator != NULL ? *allocator : default_allocator();
+    ST *st = allocator_alloc(&parent, sizeof(ST));
+    if (st == NULL) return NULL;
+    st->entries = allocator_alloc(&parent, sizeof(STEntry) * ST_INITIAL_CAPACITY);
+    st->buckets = allocator_alloc(&parent, sizeof(size_t) * ST_INITIAL_CAPACITY * 2);
+    if (st->entries == NULL || st->buckets == NULL) {
+        allocator_free(&parent, st->entries, sizeof(STEntry) * ST_INITIAL_CAPACITY);
+        allocator_free(&parent, st->buckets, sizeof(size_t) * ST_INITIAL_CAPACITY * 2);
+        allocator_free(&parent, st, sizeof(ST));
+        return NULL;
+    }
+    memset(st->buckets, 0, sizeof(size_t) * ST_INITIAL_CAPACITY * 2);
+    st->allocator = parent;
     st->capacity = ST_INITIAL_CAPACITY;
+    st->n_buckets = ST_INITIAL_CAPACITY * 2;
     st->n = 0;
     return st;
 }
 
-size_t st_insert(ST *st, const char *value) {
-    for (int i = 0; i < st->n; i++) {
-        if (strcmp(st->entries[i], value) == 0) {
-            return i;
-        }
+void st_free(ST *st) {
+    if (st == NULL) return;
+    Allocator allocator = st->allocator;
+    allocator_free(&allocator, st->entries, sizeof(STEntry) * st->capacity);
+    allocator_free(&allocator, st->buckets, sizeof(size_t) * st->n_buckets);
+    allocator_free(&allocator, st, sizeof(ST));
+}
+
+void st_clear(ST *st) {
+    st->n = 0;
+    memset(st->buckets, 0, sizeof(size_t) * st->n_buckets);
+}
+
+bool st_load(ST *st, const STEntry *entries, size_t n) {
+    if (n > st->capacity) {
+        STEntry *grown = allocator_realloc(&st->allocator, st->entries,
+                                           sizeof(STEntry) * st->capacity, sizeof(STEntry) * n);
+        if (grown == NULL) return false;
+        st->entries = grown;
+        st->capacity = n;
     }
+    if (n > 0) memcpy(st->entries, entries, sizeof(STEntry) * n);
+    st->n = n;
+    return rehash(st, n);
+}
+
+size_t st_insert(ST *st, const char *value) { return st_insert_n(st, value, strlen(value)); }
+
+size_t st_insert_n(ST *st, const char *value, size_t len) {
+    size_t *bucket = find_bucket(st, value, len);
+    if (*bucket != 0) return *bucket - 1;
 
     if (st->n == st->capacity) {
-        st->capacity += 8;
-        st->entries = realloc(st->entries, sizeof(char *) * st->capacity);
+        STEntry *entries = allocator_realloc(&st->allocator, st->entries,
+                                             sizeof(STEntry) * st->capacity,
+                                             sizeof(STEntry) * st->capacity * 2);
+        if (entries == NULL) return ST_INSERT_FAILED;
+        st->entries = entries;
+        st->capacity *= 2;
     }
 
-    st->entries[st->n++] = value;
+    st->entries[st->n++] = (STEntry){value, len};
+
+    // keep the buckets at most half full
+    if (st->n * 2 > st->n_buckets) {
+        if (!rehash(st, st->n)) {
+            st->n--;
+            return ST_INSERT_FAILED;
+        }
+    } else {
+        *bucket = st->n;
+    }
     return st->n - 1;
 }
+
+size_t st_find_n(ST *st, const char *value, size_t len) {
+    size_t id = *find_bucket(st, value, len);
+    return id != 0 ? id - 1 : ST_NOT_FOUND;
+}
+
 const char *st_get(ST *st, size_t id) {
     if (id < 0 || id >= st->n) return NULL;
-    return st->entries[id];
-}
\ No newline at end of file
+    return st->entries[id].str;
+}
+size_t st_get_len(ST *st, size_t id) {
+    if (id < 0 || id >= st->n) return 0;
+    return st->entries[id].len;
+}
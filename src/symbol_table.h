@@ -3,17 +3,59 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
 
 #define ST_INITIAL_CAPACITY 8
+// returned by st_insert when the table cannot grow
+#define ST_INSERT_FAILED ((size_t)-1)
+// returned by st_find_n for values that were never inserted
+#define ST_NOT_FOUND ((size_t)-1)
+
+typedef struct {
+    const char *str;
+    size_t len;
+} STEntry;
 
 typedef struct {
-    const char **entries;
+    Allocator allocator;
+    STEntry *entries;
     size_t capacity;
     size_t n;
+    // open addressing index over the entries, buckets hold id + 1 and 0 when empty
+    size_t *buckets;
+    size_t n_buckets;
 } ST;
 
-ST *st_create();
+/**
+ * @param allocator NULL for the default allocator
+ */
+ST *st_create(const Allocator *allocator);
+/**
+ * frees the table itself, the interned strings are owned by whoever inserted them
+ */
+void st_free(ST *st);
+/**
+ * drops every symbol but keeps the allocated capacity
+ */
+void st_clear(ST *st);
+/**
+ * replaces the contents with entries[0..n), which must be distinct, ids follow their order
+ * @return false when out of memory
+ */
+bool st_load(ST *st, const STEntry *entries, size_t n);
 size_t st_insert(ST *st, const char *value);
+/**
+ * interns value[0..len) without copying it, value need not be null terminated
+ * and must outlive the symbol table
+ */
+size_t st_insert_n(ST *st, const char *value, size_t len);
+/**
+ * id of value[0..len), ST_NOT_FOUND if it is not in the table
+ */
+size_t st_find_n(ST *st, const char *value, size_t len);
 const char *st_get(ST *st, size_t id);
+size_t st_get_len(ST *st, size_t id);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,237 @@
+#include "token_index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a, enough to notice the source changed under the index
+static uint64_t hash_source(const char *src, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)src[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static TokenIndex *new_index(const Lexer *lexer) {
+    TokenIndex *index = calloc(1, sizeof(TokenIndex));
+    if (index == NULL) return NULL;
+    index->source_len = lexer->len;
+    index->source_hash = hash_source(lexer->src, lexer->len);
+    return index;
+}
+
+static bool add_checkpoint(TokenIndex *index, LexerPosition position, size_t token) {
+    if (index->n_checkpoints == index->checkpoints_capacity) {
+        size_t capacity = index->checkpoints_capacity > 0 ? index->checkpoints_capacity * 2 : 16;
+        TokenCheckpoint *grown = realloc(index->checkpoints, sizeof(TokenCheckpoint) * capacity);
+        if (grown == NULL) return false;
+        index->checkpoints = grown;
+        index->checkpoints_capacity = capacity;
+    }
+
+    index->checkpoints[index->n_checkpoints++] =
+        (TokenCheckpoint){position.pos, token, position.row, position.col};
+    return true;
+}
+
+TokenIndex *token_index_build(Lexer *lexer, size_t every_bytes, size_t every_tokens) {
+    TokenIndex *index = new_index(lexer);
+    if (index == NULL) return NULL;
+
+    size_t token = 0;
+    LexerPosition last = lexer_tell(lexer);
+    if (!add_checkpoint(index, last, 0)) goto fail;
+
+    while (1) {
+        LexerPosition position = lexer_tell(lexer);
+        const TokenCheckpoint *previous = &index->checkpoints[index->n_checkpoints - 1];
+        if ((every_bytes > 0 && position.pos - previous->offset >= every_bytes) ||
+            (every_tokens > 0 && token - previous->token >= every_tokens)) {
+            if (!add_checkpoint(index, position, token)) goto fail;
+        }
+
+        Token result = get_token(lexer);
+        if (result.type == TOK_ERROR) goto fail;
+        if (result.type == TOK_EOF) break;
+        token++;
+    }
+
+    index->token_count = token;
+    index->n_symbols = lexer->st->n;
+    index->symbols = malloc(sizeof(STEntry) * (index->n_symbols > 0 ? index->n_symbols : 1));
+    if (index->symbols == NULL) goto fail;
+    memcpy(index->symbols, lexer->st->entries, sizeof(STEntry) * index->n_symbols);
+    return index;
+
+fail:
+    token_index_free(index);
+    return NULL;
+}
+
+bool token_index_save(const TokenIndex *index, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    uint64_t header[] = {index->source_len, index->source_hash, index->token_count,
+                         index->n_checkpoints, index->n_symbols};
+    bool ok = fwrite(TOKEN_INDEX_MAGIC, 1, 8, file) == 8 &&
+              fwrite(header, sizeof(header), 1, file) == 1 &&
+              fwrite(index->checkpoints, sizeof(TokenCheckpoint), index->n_checkpoints, file) ==
+                  index->n_checkpoints;
+
+    for (size_t i = 0; ok && i < index->n_symbols; i++) {
+        uint32_t len = index->symbols[i].len;
+        ok = fwrite(&len, sizeof(len), 1, file) == 1 &&
+             fwrite(index->symbols[i].str, 1, len, file) == len;
+    }
+
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+// bounds checked cursor over the loaded file
+typedef struct {
+    const char *p;
+    const char *end;
+} Reader;
+
+static bool take(Reader *reader, void *out, size_t n) {
+    if (reader->end - reader->p < n) return false;
+    memcpy(out, reader->p, n);
+    reader->p += n;
+    return true;
+}
+
+TokenIndex *token_index_load(const char *path, const Lexer *lexer) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = size > 0 ? malloc(size) : NULL;
+    bool ok = data != NULL && fread(data, 1, size, file) == size;
+    fclose(file);
+    if (!ok) {
+        free(data);
+        return NULL;
+    }
+
+    TokenIndex *index = calloc(1, sizeof(TokenIndex));
+    if (index == NULL) {
+        free(data);
+        return NULL;
+    }
+    index->data = data;
+
+    Reader reader = {data, data + size};
+    char magic[8];
+    uint64_t header[5];
+    if (!take(&reader, magic, sizeof(magic)) || memcmp(magic, TOKEN_INDEX_MAGIC, 8) != 0 ||
+        !take(&reader, header, sizeof(header))) {
+        goto fail;
+    }
+
+    index->source_len = header[0];
+    index->source_hash = header[1];
+    index->token_count = header[2];
+    if (index->source_len != lexer->len ||
+        index->source_hash != hash_source(lexer->src, lexer->len)) {
+        goto fail;
+    }
+
+    // every checkpoint and symbol takes at least this much of the file
+    if (header[3] == 0 || header[3] > size / sizeof(TokenCheckpoint) ||
+        header[4] > size / sizeof(uint32_t)) {
+        goto fail;
+    }
+
+    index->n_checkpoints = index->checkpoints_capacity = header[3];
+    index->checkpoints = malloc(sizeof(TokenCheckpoint) * index->n_checkpoints);
+    index->n_symbols = header[4];
+    index->symbols = malloc(sizeof(STEntry) * (index->n_symbols > 0 ? index->n_symbols : 1));
+    if (index->checkpoints == NULL || index->symbols == NULL ||
+        !take(&reader, index->checkpoints, sizeof(TokenCheckpoint) * index->n_checkpoints)) {
+        goto fail;
+    }
+
+    for (size_t i = 0; i < index->n_symbols; i++) {
+        uint32_t len;
+        if (!take(&reader, &len, sizeof(len)) || reader.end - reader.p < len) goto fail;
+        index->symbols[i] = (STEntry){reader.p, len};
+        reader.p += len;
+    }
+
+    return index;
+
+fail:
+    token_index_free(index);
+    return NULL;
+}
+
+void token_index_free(TokenIndex *index) {
+    if (index == NULL) return;
+    free(index->checkpoints);
+    free(index->symbols);
+    free(index->data);
+    free(index);
+}
+
+// last checkpoint whose token number (or offset) is <= key, checkpoints are sorted on both
+static const TokenCheckpoint *find_checkpoint(const TokenIndex *index, size_t key, bool by_token) {
+    size_t lo = 0;
+    size_t hi = index->n_checkpoints;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint64_t value = by_token ? index->checkpoints[mid].token : index->checkpoints[mid].offset;
+        if (value <= key) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return &index->checkpoints[lo];
+}
+
+static bool resume(const TokenIndex *index, Lexer *lexer, const TokenCheckpoint *checkpoint) {
+    if (!st_load(lexer->st, index->symbols, index->n_symbols)) return false;
+    lexer_seek(lexer, (LexerPosition){checkpoint->offset, checkpoint->row, checkpoint->col});
+    return true;
+}
+
+bool token_index_seek_token(const TokenIndex *index, Lexer *lexer, size_t n) {
+    if (n >= index->token_count) return false;
+
+    const TokenCheckpoint *checkpoint = find_checkpoint(index, n, true);
+    if (!resume(index, lexer, checkpoint)) return false;
+
+    for (size_t token = checkpoint->token; token < n; token++) {
+        if (get_token(lexer).type == TOK_ERROR) return false;
+    }
+    return true;
+}
+
+bool token_index_seek_offset(const TokenIndex *index, Lexer *lexer, size_t offset,
+                             size_t *token) {
+    const TokenCheckpoint *checkpoint = find_checkpoint(index, offset, false);
+    if (!resume(index, lexer, checkpoint)) return false;
+
+    size_t n = checkpoint->token;
+    while (1) {
+        LexerPosition before = lexer_tell(lexer);
+        Token result = get_token(lexer);
+        if (result.type == TOK_ERROR) return false;
+
+        // step back so the caller gets this token from its own get_token
+        if (result.type == TOK_EOF || lexer->token_start >= offset) {
+            lexer_seek(lexer, before);
+            break;
+        }
+        n++;
+    }
+
+    *token = n;
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef __TOKEN_INDEX_H__
+#define __TOKEN_INDEX_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lexer.h"
+#include "symbol_table.h"
+
+#define TOKEN_INDEX_DEFAULT_BYTES 4096
+// an index is stored next to its source as <source>.idx
+#define TOKEN_INDEX_EXTENSION ".idx"
+#define TOKEN_INDEX_MAGIC "LEXIDX01"
+
+/*
+ * On disk layout, integers in host byte order:
+ *     char magic[8]
+ *     uint64_t source_len, source_hash, token_count, checkpoint count, symbol count
+ *     TokenCheckpoint checkpoints[checkpoint count]
+ *     symbol count times: uint32_t length, char symbol[length]
+ */
+
+typedef struct {
+    // byte offset the lexer resumes from
+    uint64_t offset;
+    // number of tokens before the checkpoint
+    uint64_t token;
+    int32_t row;
+    int32_t col;
+} TokenCheckpoint;
+
+typedef struct {
+    // identify the source the index was built from
+    uint64_t source_len;
+    uint64_t source_hash;
+    uint64_t token_count;
+    TokenCheckpoint *checkpoints;
+    size_t n_checkpoints;
+    size_t checkpoints_capacity;
+    // full symbol table, restored on seek so symbol ids match a full pass
+    STEntry *symbols;
+    size_t n_symbols;
+    // file contents when loaded from disk, symbols point into it
+    char *data;
+} TokenIndex;
+
+/**
+ * lexes the whole source of a freshly created lexer, recording a checkpoint whenever
+ * every_bytes bytes or every_tokens tokens went by since the previous one
+ * pass 0 to disable either trigger, the index borrows symbols from the lexer
+ * @return NULL if the source does not lex or memory runs out
+ */
+TokenIndex *token_index_build(Lexer *lexer, size_t every_bytes, size_t every_tokens);
+bool token_index_save(const TokenIndex *index, const char *path);
+/**
+ * @return NULL if the file is missing, malformed or was built from another source
+ */
+TokenIndex *token_index_load(const char *path, const Lexer *lexer);
+void token_index_free(TokenIndex *index);
+
+/**
+ * positions the lexer so that the next get_token returns token n (0 based)
+ */
+bool token_index_seek_token(const TokenIndex *index, Lexer *lexer, size_t n);
+/**
+ * positions the lexer on the first token starting at or after offset
+ * @param token receives the number of that token
+ */
+bool token_index_seek_offset(const TokenIndex *index, Lexer *lexer, size_t offset,
+                             size_t *token);
+
+#endif
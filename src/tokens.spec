@@ -0,0 +1,120 @@
+# Token specification for the lexer.
+#
+# tools/gentokens.c turns this file into src/tokens.gen.h, src/tokens.gen.c and
+# src/scanner.gen.inc when the project is built, edit this file instead of those.
+#
+#   token NAME                      token class TOK_NAME, classes are numbered in file order
+#   keyword word                    reserved word, becomes the class TOK_KEYWORD_WORD
+#   values Type PREFIX fn NAME...   enum Type of PREFIXNAME values carried by a class,
+#                                   fn(Type) returns the name of a value
+#   operator "text" NAME [VALUE]    fixed spelling of class TOK_NAME, longest match wins
+#   comment "text"                  starts a comment running to the end of the line
+
+token IDENTIFIER
+
+# numbers
+token INT
+token DOUBLE
+token SCIENTIFIC
+
+# operators
+token RELOP
+
+# end of file
+token EOF
+
+keyword auto
+keyword break
+keyword case
+keyword char
+keyword const
+keyword continue
+keyword default
+keyword do
+keyword double
+keyword else
+keyword enum
+keyword extern
+keyword float
+keyword for
+keyword goto
+keyword if
+keyword int
+keyword long
+keyword register
+keyword return
+keyword short
+keyword signed
+keyword sizeof
+keyword static
+keyword struct
+keyword switch
+keyword typedef
+keyword union
+keyword unsigned
+keyword void
+keyword volatile
+keyword while
+
+# literals
+token STRING_LITERAL
+
+# symbols
+token R_BRACE
+token L_BRACE
+token R_PARAN
+token L_PARAN
+token R_SQUARE_BRACKET
+token L_SQUARE_BRACKET
+token R_ANGLE_BRACKET
+token L_ANGLE_BRACKET
+
+# operators
+token ARITHMETIC_OPERATOR
+token LOGICAL_OPERATOR
+
+# misc
+token EQUAL
+token SEMI_COLON
+token COLON
+token COMMA
+token DOT
+
+values RelOp RELOP_ relop_to_str LT GT EQ LE GE NE
+values ArithmeticOperator A_OP_ arithmetic_op_to_str PLUS MINUS DIV MUL EXP MOD DOUBLE_PLUS DOUBLE_MINUS
+values LogicalOperator L_OP_ logical_op_to_str AND OR NOT
+
+operator ">" RELOP RELOP_GT
+operator ">=" RELOP RELOP_GE
+operator "<" RELOP RELOP_LT
+operator "<=" RELOP RELOP_LE
+operator "<>" RELOP RELOP_NE
+operator "==" RELOP RELOP_EQ
+operator "=" EQUAL
+
+operator "+" ARITHMETIC_OPERATOR A_OP_PLUS
+operator "++" ARITHMETIC_OPERATOR A_OP_DOUBLE_PLUS
+operator "-" ARITHMETIC_OPERATOR A_OP_MINUS
+operator "--" ARITHMETIC_OPERATOR A_OP_DOUBLE_MINUS
+operator "/" ARITHMETIC_OPERATOR A_OP_DIV
+operator "*" ARITHMETIC_OPERATOR A_OP_MUL
+operator "**" ARITHMETIC_OPERATOR A_OP_EXP
+operator "%" ARITHMETIC_OPERATOR A_OP_MOD
+
+operator "(" L_PARAN
+operator ")" R_PARAN
+operator "[" L_SQUARE_BRACKET
+operator "]" R_SQUARE_BRACKET
+operator "{" L_BRACE
+operator "}" R_BRACE
+
+operator "&&" LOGICAL_OPERATOR L_OP_AND
+operator "||" LOGICAL_OPERATOR L_OP_OR
+operator "!" LOGICAL_OPERATOR L_OP_NOT
+
+operator ";" SEMI_COLON
+operator ":" COLON
+operator "," COMMA
+operator "." DOT
+
+comment "//"
@@ -0,0 +1,132 @@
+#include "utf8.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef struct {
+    uint32_t lo;
+    uint32_t hi;
+} CodePointRange;
+
+// C11 Annex D.1, ranges of characters allowed in identifiers
+static const CodePointRange identifier_ranges[] = {
+    {0x00A8, 0x00A8},   {0x00AA, 0x00AA},   {0x00AD, 0x00AD},   {0x00AF, 0x00AF},
+    {0x00B2, 0x00B5},   {0x00B7, 0x00BA},   {0x00BC, 0x00BE},   {0x00C0, 0x00D6},
+    {0x00D8, 0x00F6},   {0x00F8, 0x167F},   {0x1681, 0x180D},   {0x180F, 0x1FFF},
+    {0x200B, 0x200D},   {0x202A, 0x202E},   {0x203F, 0x2040},   {0x2054, 0x2054},
+    {0x2060, 0x218F},   {0x2460, 0x24FF},   {0x2776, 0x2793},   {0x2C00, 0x2DFF},
+    {0x2E80, 0x2FFF},   {0x3004, 0x3007},   {0x3021, 0x302F},   {0x3031, 0xD7FF},
+    {0xF900, 0xFD3D},   {0xFD40, 0xFDCF},   {0xFDF0, 0xFE44},   {0xFE47, 0xFFFD},
+    {0x10000, 0x1FFFD}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}, {0x40000, 0x4FFFD},
+    {0x50000, 0x5FFFD}, {0x60000, 0x6FFFD}, {0x70000, 0x7FFFD}, {0x80000, 0x8FFFD},
+    {0x90000, 0x9FFFD}, {0xA0000, 0xAFFFD}, {0xB0000, 0xBFFFD}, {0xC0000, 0xCFFFD},
+    {0xD0000, 0xDFFFD}, {0xE0000, 0xEFFFD}};
+
+// C11 Annex D.2, ranges of characters not allowed to start an identifier
+static const CodePointRange non_initial_ranges[] = {
+    {0x0300, 0x036F}, {0x1DC0, 0x1DFF}, {0x20D0, 0x20FF}, {0xFE20, 0xFE2F}};
+
+static bool in_ranges(const CodePointRange *ranges, size_t n, uint32_t cp) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cp < ranges[mid].lo) {
+            hi = mid;
+        } else if (cp > ranges[mid].hi) {
+            lo = mid + 1;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool utf8_is_identifier(uint32_t cp, bool start) {
+    if (!in_ranges(identifier_ranges, sizeof(identifier_ranges) / sizeof(identifier_ranges[0]),
+                   cp)) {
+        return false;
+    }
+    return !start || !in_ranges(non_initial_ranges,
+                                sizeof(non_initial_ranges) / sizeof(non_initial_ranges[0]), cp);
+}
+
+// length of a well formed sequence starting at s[0..n), 0 if it is malformed
+static int sequence_length(const uint8_t *s, size_t n) {
+    uint8_t c = s[0];
+    int len;
+    uint8_t min = 0x80;
+    uint8_t max = 0xBF;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        len = 3;
+        // reject overlongs and surrogates
+        if (c == 0xE0) min = 0xA0;
+        if (c == 0xED) max = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        len = 4;
+        // reject overlongs and code points past U+10FFFF
+        if (c == 0xF0) min = 0x90;
+        if (c == 0xF4) max = 0x8F;
+    } else {
+        return 0;
+    }
+
+    if (n < len) return 0;
+    if (s[1] < min || s[1] > max) return 0;
+    for (int i = 2; i < len; i++) {
+        if (s[i] < 0x80 || s[i] > 0xBF) return 0;
+    }
+    return len;
+}
+
+size_t utf8_validate(const char *buf, size_t n) {
+    const uint8_t *s = (const uint8_t *)buf;
+    size_t i = 0;
+    while (i < n) {
+#if defined(__SSE2__)
+        // skip runs of ascii sixteen bytes at a time
+        while (i + 16 <= n) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+            int mask = _mm_movemask_epi8(chunk);
+            if (mask != 0) {
+                i += __builtin_ctz(mask);
+                break;
+            }
+            i += 16;
+        }
+        if (i >= n) break;
+#endif
+        if (s[i] < 0x80) {
+            i++;
+            continue;
+        }
+
+        int len = sequence_length(s + i, n - i);
+        if (len == 0) return i;
+        i += len;
+    }
+    return n;
+}
+
+uint32_t utf8_decode(const char *str, int *len) {
+    const uint8_t *s = (const uint8_t *)str;
+    if (s[0] < 0x80) {
+        *len = 1;
+        return s[0];
+    }
+    if (s[0] < 0xE0) {
+        *len = 2;
+        return ((uint32_t)(s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    }
+    if (s[0] < 0xF0) {
+        *len = 3;
+        return ((uint32_t)(s[0] & 0x0F) << 12) | ((uint32_t)(s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+    }
+    *len = 4;
+    return ((uint32_t)(s[0] & 0x07) << 18) | ((uint32_t)(s[1] & 0x3F) << 12) |
+           ((uint32_t)(s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+}
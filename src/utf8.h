@@ -0,0 +1,26 @@
+#ifndef __UTF8_H__
+#define __UTF8_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * checks that buf[0..n) is well formed UTF-8
+ * @return offset of the first invalid byte, n if the whole buffer is valid
+ */
+size_t utf8_validate(const char *buf, size_t n);
+
+/**
+ * decodes the code point starting at s, which must be valid UTF-8
+ * @param len receives the number of bytes of the encoding
+ */
+uint32_t utf8_decode(const char *s, int *len);
+
+/**
+ * whether a non ascii code point may appear in an identifier (C11 Annex D)
+ * @param start true for the first character of the identifier
+ */
+bool utf8_is_identifier(uint32_t cp, bool start);
+
+#endif
@@ -0,0 +1,614 @@
+#include "watch.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS                                                                   \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR | \
+     IN_DONT_FOLLOW)
+#define WATCH_MAX_QUERY 4096
+
+static bool grow(void **items, size_t *capacity, size_t n, size_t size) {
+    if (n < *capacity) return true;
+    size_t grown_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    void *grown = realloc(*items, grown_capacity * size);
+    if (grown == NULL) return false;
+    *items = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    char *path = malloc(dir_len + strlen(name) + 2);
+    if (path == NULL) return NULL;
+    strcpy(path, dir);
+    path[dir_len] = '/';
+    strcpy(path + dir_len + 1, name);
+    return path;
+}
+
+// whether path is prefix itself or lies below it
+static bool is_under(const char *path, const char *prefix) {
+    size_t len = strlen(prefix);
+    return strncmp(path, prefix, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+static size_t hash_path(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *path != '\0'; path++) {
+        hash ^= (uint8_t)*path;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// bucket holding index + 1 of the file at path, or the empty bucket it would go in
+static size_t *find_file_bucket(Watcher *watcher, const char *path) {
+    size_t mask = watcher->n_file_buckets - 1;
+    for (size_t i = hash_path(path) & mask;; i = (i + 1) & mask) {
+        size_t index = watcher->file_buckets[i];
+        if (index == 0 || strcmp(watcher->files[index - 1]->path, path) == 0) {
+            return &watcher->file_buckets[i];
+        }
+    }
+}
+
+// sizes the buckets for n files and indexes the current ones
+static bool reindex_files(Watcher *watcher, size_t n) {
+    size_t n_buckets = watcher->n_file_buckets > 0 ? watcher->n_file_buckets : 16;
+    while (n * 2 > n_buckets) n_buckets *= 2;
+
+    if (n_buckets != watcher->n_file_buckets) {
+        size_t *buckets = realloc(watcher->file_buckets, sizeof(size_t) * n_buckets);
+        if (buckets == NULL) return false;
+        watcher->file_buckets = buckets;
+        watcher->n_file_buckets = n_buckets;
+    }
+
+    memset(watcher->file_buckets, 0, sizeof(size_t) * watcher->n_file_buckets);
+    for (size_t i = 0; i < watcher->n_files; i++) {
+        *find_file_bucket(watcher, watcher->files[i]->path) = i + 1;
+    }
+    return true;
+}
+
+// indexes the file just appended to files, keeping the buckets at most half full
+static bool index_last_file(Watcher *watcher) {
+    if (watcher->n_files * 2 > watcher->n_file_buckets) {
+        return reindex_files(watcher, watcher->n_files);
+    }
+    *find_file_bucket(watcher, watcher->files[watcher->n_files - 1]->path) = watcher->n_files;
+    return true;
+}
+
+WatchedFile *watcher_find(Watcher *watcher, const char *path) {
+    size_t index = *find_file_bucket(watcher, path);
+    return index != 0 ? watcher->files[index - 1] : NULL;
+}
+
+static void clear_file(WatchedFile *file) {
+    free_lexer(file->lexer);
+    free(file->tokens);
+    free(file->symbol_ids);
+    file->lexer = NULL;
+    file->tokens = NULL;
+    file->symbol_ids = NULL;
+    file->n_tokens = 0;
+}
+
+static void free_file(WatchedFile *file) {
+    clear_file(file);
+    free(file->path);
+    free(file);
+}
+
+// forgets files[i], the last file takes its place
+static void remove_file_at(Watcher *watcher, size_t i) {
+    size_t mask = watcher->n_file_buckets - 1;
+    size_t hole = find_file_bucket(watcher, watcher->files[i]->path) - watcher->file_buckets;
+
+    // shift later entries of the probe run back so that none becomes unreachable, an entry
+    // stays put if its home bucket lies (cyclically) after the hole
+    for (size_t j = (hole + 1) & mask; watcher->file_buckets[j] != 0; j = (j + 1) & mask) {
+        size_t home = hash_path(watcher->files[watcher->file_buckets[j] - 1]->path) & mask;
+        bool stays = hole < j ? home > hole && home <= j : home > hole || home <= j;
+        if (!stays) {
+            watcher->file_buckets[hole] = watcher->file_buckets[j];
+            hole = j;
+        }
+    }
+    watcher->file_buckets[hole] = 0;
+
+    free_file(watcher->files[i]);
+    size_t last = --watcher->n_files;
+    if (i != last) {
+        watcher->files[i] = watcher->files[last];
+        *find_file_bucket(watcher, watcher->files[i]->path) = i + 1;
+    }
+}
+
+static void remove_file(Watcher *watcher, const char *path) {
+    size_t index = *find_file_bucket(watcher, path);
+    if (index != 0) remove_file_at(watcher, index - 1);
+}
+
+static uint32_t intern_global(Watcher *watcher, const char *value, size_t len) {
+    size_t id = st_find_n(watcher->symbols, value, len);
+    if (id != ST_NOT_FOUND) return id;
+
+    // the file's source goes away on the next change, the global table keeps its own copy
+    char *copy = arena_alloc(watcher->symbol_arena, len > 0 ? len : 1);
+    if (copy == NULL) return WATCH_NO_SYMBOL;
+    memcpy(copy, value, len);
+
+    id = st_insert_n(watcher->symbols, copy, len);
+    return id == ST_INSERT_FAILED ? WATCH_NO_SYMBOL : id;
+}
+
+// lexes path from scratch, replacing whatever was known about it, info is its stat from
+// before it is read
+static void lex_file(Watcher *watcher, const char *path, const struct stat *info) {
+    WatchedFile *file = watcher_find(watcher, path);
+    if (file == NULL) {
+        if (!grow((void **)&watcher->files, &watcher->files_capacity, watcher->n_files,
+                  sizeof(WatchedFile *))) {
+            return;
+        }
+        file = calloc(1, sizeof(WatchedFile));
+        if (file == NULL || (file->path = strdup(path)) == NULL) {
+            free(file);
+            return;
+        }
+        watcher->files[watcher->n_files++] = file;
+        if (!index_last_file(watcher)) {
+            watcher->n_files--;
+            free_file(file);
+            return;
+        }
+    }
+
+    clear_file(file);
+    file->is_error = true;
+    file->mtime = info->st_mtim;
+    file->size = info->st_size;
+    file->lexer = create_lexer(file->path, NULL);
+    if (file->lexer == NULL) {
+        fprintf(stderr, "%s: %s\n", file->path, strerror(errno));
+        return;
+    }
+
+    Lexer *lexer = file->lexer;
+    size_t capacity = 0;
+    while (1) {
+        Token token = get_token(lexer);
+        if (token.type == TOK_EOF) {
+            file->is_error = false;
+            break;
+        }
+        if (token.type == TOK_ERROR) break;
+
+        if (!grow((void **)&file->tokens, &capacity, file->n_tokens, sizeof(WatchToken))) break;
+        WatchToken *record = &file->tokens[file->n_tokens++];
+        *record = (WatchToken){token.type, token.value, WATCH_NO_SYMBOL, lexer->token_row,
+                               lexer->token_col};
+        if (token.type == TOK_INT) {
+            record->number.i = lexer->val_int;
+        } else if (token.type == TOK_DOUBLE || token.type == TOK_SCIENTIFIC) {
+            record->number.d = lexer->val_double;
+        }
+    }
+
+    file->symbol_ids = malloc(sizeof(uint32_t) * (lexer->st->n > 0 ? lexer->st->n : 1));
+    if (file->symbol_ids == NULL) {
+        file->is_error = true;
+        file->n_tokens = 0;
+        return;
+    }
+    for (size_t i = 0; i < lexer->st->n; i++) {
+        file->symbol_ids[i] =
+            intern_global(watcher, st_get(lexer->st, i), st_get_len(lexer->st, i));
+    }
+
+    for (size_t i = 0; i < file->n_tokens; i++) {
+        WatchToken *record = &file->tokens[i];
+        if (record->type == TOK_IDENTIFIER || record->type == TOK_STRING_LITERAL) {
+            record->symbol = file->symbol_ids[record->value];
+        }
+    }
+}
+
+// forgets every file and directory at or below path
+static void remove_tree(Watcher *watcher, const char *path) {
+    for (size_t i = 0; i < watcher->n_files;) {
+        if (is_under(watcher->files[i]->path, path)) {
+            remove_file_at(watcher, i);
+        } else {
+            i++;
+        }
+    }
+
+    for (size_t i = 0; i < watcher->n_dirs;) {
+        if (is_under(watcher->dirs[i].path, path)) {
+            inotify_rm_watch(watcher->inotify_fd, watcher->dirs[i].wd);
+            free(watcher->dirs[i].path);
+            watcher->dirs[i] = watcher->dirs[--watcher->n_dirs];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void drop_dir(Watcher *watcher, int wd) {
+    for (size_t i = 0; i < watcher->n_dirs; i++) {
+        if (watcher->dirs[i].wd == wd) {
+            free(watcher->dirs[i].path);
+            watcher->dirs[i] = watcher->dirs[--watcher->n_dirs];
+            return;
+        }
+    }
+}
+
+static const char *dir_path(Watcher *watcher, int wd) {
+    for (size_t i = 0; i < watcher->n_dirs; i++) {
+        if (watcher->dirs[i].wd == wd) return watcher->dirs[i].path;
+    }
+    return NULL;
+}
+
+// whether the file at path was never lexed or changed since
+static bool is_stale(Watcher *watcher, const char *path, const struct stat *info) {
+    const WatchedFile *file = watcher_find(watcher, path);
+    return file == NULL || file->size != info->st_size ||
+           file->mtime.tv_sec != info->st_mtim.tv_sec ||
+           file->mtime.tv_nsec != info->st_mtim.tv_nsec;
+}
+
+// watches path and lexes every file below it that is new or changed, hidden entries are
+// skipped
+static bool add_tree(Watcher *watcher, const char *path) {
+    int wd = inotify_add_watch(watcher->inotify_fd, path, WATCH_EVENTS);
+    if (wd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // a directory moved back into the tree reuses its watch
+    drop_dir(watcher, wd);
+    if (!grow((void **)&watcher->dirs, &watcher->dirs_capacity, watcher->n_dirs,
+              sizeof(WatchedDir))) {
+        return false;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) return false;
+    watcher->dirs[watcher->n_dirs++] = (WatchedDir){copy, wd};
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) return false;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        char *child = join_path(path, entry->d_name);
+        if (child == NULL) break;
+
+        struct stat info;
+        if (lstat(child, &info) == 0) {
+            if (S_ISDIR(info.st_mode)) {
+                add_tree(watcher, child);
+            } else if (S_ISREG(info.st_mode) && is_stale(watcher, child, &info)) {
+                lex_file(watcher, child, &info);
+            }
+        }
+        free(child);
+    }
+    closedir(dir);
+    return true;
+}
+
+Watcher *watcher_create(const char *root) {
+    Watcher *watcher = calloc(1, sizeof(Watcher));
+    if (watcher == NULL) return NULL;
+
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher->root = strdup(root);
+    watcher->symbols = st_create(NULL);
+    watcher->symbol_arena = arena_create(NULL);
+    if (watcher->inotify_fd < 0 || watcher->root == NULL || watcher->symbols == NULL ||
+        watcher->symbol_arena == NULL || !reindex_files(watcher, 0) || !add_tree(watcher, root)) {
+        watcher_free(watcher);
+        return NULL;
+    }
+    return watcher;
+}
+
+void watcher_free(Watcher *watcher) {
+    if (watcher == NULL) return;
+    for (size_t i = 0; i < watcher->n_files; i++) free_file(watcher->files[i]);
+    for (size_t i = 0; i < watcher->n_dirs; i++) free(watcher->dirs[i].path);
+    if (watcher->inotify_fd >= 0) close(watcher->inotify_fd);
+    free(watcher->root);
+    st_free(watcher->symbols);
+    arena_free(watcher->symbol_arena);
+    free(watcher->files);
+    free(watcher->file_buckets);
+    free(watcher->dirs);
+    free(watcher);
+}
+
+typedef struct {
+    char **paths;
+    size_t n;
+    size_t capacity;
+} PathSet;
+
+// duplicates are dropped by path_set_sort
+static void path_set_add(PathSet *set, const char *path) {
+    char *copy = strdup(path);
+    if (copy == NULL || !grow((void **)&set->paths, &set->capacity, set->n, sizeof(char *))) {
+        free(copy);
+        return;
+    }
+    set->paths[set->n++] = copy;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// sorts the paths and drops duplicates
+static void path_set_sort(PathSet *set) {
+    if (set->n == 0) return;
+    qsort(set->paths, set->n, sizeof(char *), compare_paths);
+    size_t n = 1;
+    for (size_t i = 1; i < set->n; i++) {
+        if (strcmp(set->paths[i], set->paths[n - 1]) == 0) {
+            free(set->paths[i]);
+        } else {
+            set->paths[n++] = set->paths[i];
+        }
+    }
+    set->n = n;
+}
+
+static void path_set_remove_tree(PathSet *set, const char *path) {
+    for (size_t i = 0; i < set->n;) {
+        if (is_under(set->paths[i], path)) {
+            free(set->paths[i]);
+            set->paths[i] = set->paths[--set->n];
+        } else {
+            i++;
+        }
+    }
+}
+
+// after the event queue overflowed there is no telling what changed, so the tree is compared
+// with what was lexed: vanished paths are forgotten, new and modified files lexed again
+static void rescan(Watcher *watcher) {
+    struct stat info;
+    for (size_t i = 0; i < watcher->n_dirs;) {
+        if (lstat(watcher->dirs[i].path, &info) == 0 && S_ISDIR(info.st_mode)) {
+            i++;
+            continue;
+        }
+        // remove_tree frees the entry it is matching against
+        char *path = strdup(watcher->dirs[i].path);
+        if (path == NULL) return;
+        remove_tree(watcher, path);
+        free(path);
+    }
+
+    for (size_t i = 0; i < watcher->n_files;) {
+        if (lstat(watcher->files[i]->path, &info) == 0 && S_ISREG(info.st_mode)) {
+            i++;
+        } else {
+            remove_file_at(watcher, i);
+        }
+    }
+
+    add_tree(watcher, watcher->root);
+}
+
+bool watcher_poll(Watcher *watcher) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    // files written several times in one batch are only lexed once
+    PathSet changed = {NULL, 0, 0};
+    bool overflowed = false;
+    bool ok = true;
+
+    while (1) {
+        ssize_t len = read(watcher->inotify_fd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            ok = errno == EAGAIN;
+            break;
+        }
+        if (len == 0) break;
+
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            // events were dropped, only a full rescan can tell what they were
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED) {
+                drop_dir(watcher, event->wd);
+                continue;
+            }
+
+            const char *dir = dir_path(watcher, event->wd);
+            if (dir == NULL || event->len == 0 || event->name[0] == '.') continue;
+
+            char *path = join_path(dir, event->name);
+            if (path == NULL) continue;
+
+            bool created = event->mask & (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE);
+            bool removed = event->mask & (IN_DELETE | IN_MOVED_FROM);
+            if (event->mask & IN_ISDIR) {
+                if (created) {
+                    add_tree(watcher, path);
+                } else if (removed) {
+                    remove_tree(watcher, path);
+                    path_set_remove_tree(&changed, path);
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                path_set_add(&changed, path);
+            } else if (removed) {
+                remove_file(watcher, path);
+                path_set_remove_tree(&changed, path);
+            }
+            free(path);
+        }
+    }
+
+    path_set_sort(&changed);
+    for (size_t i = 0; i < changed.n; i++) {
+        // the file may be gone again by the time the batch is handled
+        struct stat info;
+        if (stat(changed.paths[i], &info) == 0) {
+            lex_file(watcher, changed.paths[i], &info);
+        } else {
+            remove_file(watcher, changed.paths[i]);
+        }
+        free(changed.paths[i]);
+    }
+    free(changed.paths);
+
+    if (overflowed) rescan(watcher);
+    return ok;
+}
+
+static void print_watch_token(Watcher *watcher, const WatchToken *token) {
+    printf("%d:%d %s", token->row, token->col, tok_to_str(token->type));
+
+    if (token->symbol != WATCH_NO_SYMBOL) {
+        printf(": (%u) %.*s", token->symbol, (int)st_get_len(watcher->symbols, token->symbol),
+               st_get(watcher->symbols, token->symbol));
+    }
+
+    if (token->type == TOK_INT) {
+        printf(": %lld", (long long)token->number.i);
+    }
+
+    if (token->type == TOK_DOUBLE || token->type == TOK_SCIENTIFIC) {
+        printf(": %lf", token->number.d);
+    }
+
+    if (token->type == TOK_RELOP) {
+        printf(": %s", relop_to_str(token->value));
+    }
+
+    if (token->type == TOK_ARITHMETIC_OPERATOR) {
+        printf(": %s", arithmetic_op_to_str(token->value));
+    }
+
+    if (token->type == TOK_LOGICAL_OPERATOR) {
+        printf(": %s", logical_op_to_str(token->value));
+    }
+
+    printf("\n");
+}
+
+// answers one query line, every answer ends with an empty line
+static void answer(Watcher *watcher, char *query) {
+    char *command = strtok(query, " \t\r");
+    char *argument = strtok(NULL, "\r");
+
+    if (command == NULL) {
+        // empty line, nothing to answer
+        return;
+    } else if (strcmp(command, "files") == 0) {
+        for (size_t i = 0; i < watcher->n_files; i++) {
+            const WatchedFile *file = watcher->files[i];
+            printf("%s %zu tokens%s\n", file->path, file->n_tokens,
+                   file->is_error ? " (error)" : "");
+        }
+    } else if (strcmp(command, "symbol") == 0 && argument != NULL) {
+        size_t id = strtoull(argument, NULL, 10);
+        if (id < watcher->symbols->n) {
+            printf("%.*s\n", (int)st_get_len(watcher->symbols, id), st_get(watcher->symbols, id));
+        } else {
+            printf("error: no symbol %s\n", argument);
+        }
+    } else if ((strcmp(command, "tokens") == 0 || strcmp(command, "symbols") == 0) &&
+               argument != NULL) {
+        WatchedFile *file = watcher_find(watcher, argument);
+        if (file == NULL) {
+            printf("error: %s is not watched\n", argument);
+        } else if (command[0] == 't') {
+            for (size_t i = 0; i < file->n_tokens; i++) {
+                print_watch_token(watcher, &file->tokens[i]);
+            }
+        } else if (file->lexer != NULL) {
+            for (size_t i = 0; i < file->lexer->st->n; i++) {
+                uint32_t id = file->symbol_ids[i];
+                printf("%u %.*s\n", id, (int)st_get_len(watcher->symbols, id),
+                       st_get(watcher->symbols, id));
+            }
+        }
+    } else {
+        printf("error: unknown query '%s'\n", command);
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+int run_watch(const char *root) {
+    Watcher *watcher = watcher_create(root);
+    if (watcher == NULL) return 1;
+
+    fprintf(stderr, "watching %s: %zu files, %zu symbols\n", root, watcher->n_files,
+            watcher->symbols->n);
+
+    char input[WATCH_MAX_QUERY];
+    size_t input_len = 0;
+    struct pollfd fds[] = {{watcher->inotify_fd, POLLIN}, {STDIN_FILENO, POLLIN}};
+
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) watcher_poll(watcher);
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            ssize_t got = read(STDIN_FILENO, input + input_len, sizeof(input) - input_len - 1);
+            if (got <= 0) break;
+            input_len += got;
+
+            // catch up on changes so answers reflect the tree as it is now
+            watcher_poll(watcher);
+
+            char *line = input;
+            char *newline;
+            while ((newline = memchr(line, '\n', input + input_len - line)) != NULL) {
+                *newline = '\0';
+                answer(watcher, line);
+                line = newline + 1;
+            }
+
+            input_len -= line - input;
+            memmove(input, line, input_len);
+            // drop queries that do not fit the buffer
+            if (input_len == sizeof(input) - 1) input_len = 0;
+        }
+    }
+
+    watcher_free(watcher);
+    return 0;
+}
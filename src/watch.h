@@ -0,0 +1,94 @@
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "symbol_table.h"
+
+// symbol field of tokens that do not refer to a symbol
+#define WATCH_NO_SYMBOL UINT32_MAX
+
+typedef struct {
+    int32_t type;
+    int32_t value;
+    // global symbol id for identifiers and string literals
+    uint32_t symbol;
+    int32_t row;
+    int32_t col;
+    union {
+        int64_t i;
+        double d;
+    } number;
+} WatchToken;
+
+// lexing result of one file, replaced as a whole when the file changes
+typedef struct {
+    char *path;
+    // keeps the source and the per file symbol table alive, NULL if the file could not be read
+    Lexer *lexer;
+    WatchToken *tokens;
+    size_t n_tokens;
+    // global id of every per file symbol
+    uint32_t *symbol_ids;
+    // the file did not lex completely, tokens holds everything before the error
+    bool is_error;
+    // what the file looked like when it was lexed, compared on a rescan
+    struct timespec mtime;
+    off_t size;
+} WatchedFile;
+
+typedef struct {
+    char *path;
+    int wd;
+} WatchedDir;
+
+typedef struct {
+    int inotify_fd;
+    // rescanned when the kernel drops events
+    char *root;
+    WatchedDir *dirs;
+    size_t n_dirs;
+    size_t dirs_capacity;
+    WatchedFile **files;
+    size_t n_files;
+    size_t files_capacity;
+    // open addressing index over files by path, buckets hold index + 1 and 0 when empty
+    size_t *file_buckets;
+    size_t n_file_buckets;
+    // ids stay the same for the lifetime of the watcher, the symbols are copied into the arena
+    ST *symbols;
+    Arena *symbol_arena;
+} Watcher;
+
+/**
+ * lexes every file under root and starts watching the tree
+ * @return NULL if root cannot be watched
+ */
+Watcher *watcher_create(const char *root);
+void watcher_free(Watcher *watcher);
+
+/**
+ * re-lexes the files touched since the last call, never blocks, rescans the whole tree if
+ * the event queue overflowed
+ * @return false if reading inotify events failed
+ */
+bool watcher_poll(Watcher *watcher);
+WatchedFile *watcher_find(Watcher *watcher, const char *path);
+
+/**
+ * watches root, answering queries read line by line from stdin until it is closed:
+ *     files            every file with its token count
+ *     tokens <path>    token stream of a file
+ *     symbols <path>   global id and text of every symbol of a file
+ *     symbol <id>      text of a global symbol id
+ * @return 0 on success, 1 if root cannot be watched
+ */
+int run_watch(const char *root);
+
+#endif
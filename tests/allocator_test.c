@@ -0,0 +1,131 @@
+// Checks the allocators on their own and threaded through the lexer, run by make check.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/allocator.h"
+#include "../src/arena.h"
+#include "../src/lexer.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+static const char *sample_path = "my_source_code";
+
+// lexes the whole lexer, returns the number of tokens or -1 on error
+static long lex_all(Lexer *lexer) {
+    long n = 0;
+    while (1) {
+        Token token = get_token(lexer);
+        if (token.type == TOK_EOF) return n;
+        if (token.type == TOK_ERROR) return -1;
+        n++;
+    }
+}
+
+static void test_counting_realloc() {
+    CountingAllocator counter;
+    counting_allocator_init(&counter, NULL, 0);
+    Allocator allocator = counting_allocator(&counter);
+
+    char *p = allocator_alloc(&allocator, 100);
+    CHECK(p != NULL);
+    p = allocator_realloc(&allocator, p, 100, 300);
+    CHECK(p != NULL);
+    // growing is not a new allocation and only the growth is new bytes
+    CHECK(counter.allocations == 1);
+    CHECK(counter.total == 300);
+    CHECK(counter.in_use == 300);
+
+    p = allocator_realloc(&allocator, p, 300, 50);
+    CHECK(counter.in_use == 50);
+    CHECK(counter.total == 300);
+    CHECK(counter.peak == 300);
+
+    allocator_free(&allocator, p, 50);
+    CHECK(counter.in_use == 0);
+}
+
+static void test_counting_limit() {
+    CountingAllocator counter;
+    counting_allocator_init(&counter, NULL, 200);
+    Allocator allocator = counting_allocator(&counter);
+
+    void *a = allocator_alloc(&allocator, 150);
+    CHECK(a != NULL);
+    CHECK(!counter.limit_hit);
+    CHECK(allocator_alloc(&allocator, 100) == NULL);
+    CHECK(counter.limit_hit);
+    CHECK(allocator_realloc(&allocator, a, 150, 250) == NULL);
+    CHECK(counter.in_use == 150);
+    allocator_free(&allocator, a, 150);
+}
+
+// arena -> counting -> lexer, everything the lexer takes is given back by free_lexer
+static void test_lexer_on_arena() {
+    Arena *arena = arena_create(NULL);
+    CHECK(arena != NULL);
+    Allocator arena_memory = arena_allocator(arena);
+
+    CountingAllocator counter;
+    counting_allocator_init(&counter, &arena_memory, 0);
+    Allocator allocator = counting_allocator(&counter);
+
+    Lexer *lexer = create_lexer(sample_path, &allocator);
+    CHECK(lexer != NULL);
+    if (lexer != NULL) {
+        CHECK(lex_all(lexer) == 104);
+        free_lexer(lexer);
+    }
+    CHECK(counter.allocations > 0);
+    CHECK(counter.in_use == 0);
+    arena_free(arena);
+}
+
+// an allocation failing in the middle of a token is an error, not a shorter token
+static void test_limit_mid_token() {
+    size_t digits = 10000;
+    char *src = malloc(digits + 3);
+    memset(src, '1', digits);
+    memcpy(src + digits, ".5", 3);
+
+    CountingAllocator counter;
+    counting_allocator_init(&counter, NULL, 0);
+    Allocator allocator = counting_allocator(&counter);
+
+    Lexer *lexer = create_lexer_from_buffer("<number>", src, digits + 2, &allocator);
+    CHECK(lexer != NULL);
+    if (lexer != NULL) {
+        // only the digits can go over the limit
+        counter.limit = counter.in_use + digits / 2;
+        CHECK(get_token(lexer).type == TOK_ERROR);
+        CHECK(counter.limit_hit);
+        free_lexer(lexer);
+    }
+    CHECK(counter.in_use == 0);
+    free(src);
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc > 1) sample_path = argv[1];
+
+    test_counting_realloc();
+    test_counting_limit();
+    test_lexer_on_arena();
+    test_limit_mid_token();
+
+    if (failures > 0) {
+        fprintf(stderr, "allocator_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("allocator_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,284 @@
+// Talks to ./main --daemon over its unix socket protocol, run by make check.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/daemon.h"
+#include "../src/tokens.gen.h"
+
+// longest a test waits for an answer or for the daemon to exit
+#define TEST_TIMEOUT 5
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+static const char *main_path;
+static char socket_path[108];
+
+typedef struct {
+    DaemonToken tokens[256];
+    size_t n_tokens;
+    uint32_t n_symbols;
+    char symbols[64][64];
+} Response;
+
+static void sleep_ms(long ms) {
+    struct timespec delay = {ms / 1000, (ms % 1000) * 1000000};
+    nanosleep(&delay, NULL);
+}
+
+// -1 if nothing accepts connections on the socket
+static int connect_client() {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct timeval timeout = {.tv_sec = TEST_TIMEOUT};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static pid_t start_daemon(int threads) {
+    char thread_count[16];
+    snprintf(thread_count, sizeof(thread_count), "%d", threads);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(main_path, main_path, "--daemon", socket_path, "--threads", thread_count,
+              (char *)NULL);
+        _exit(127);
+    }
+
+    // wait until it listens
+    for (int i = 0; i < 500; i++) {
+        int fd = connect_client();
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        sleep_ms(10);
+    }
+    fprintf(stderr, "daemon_test: daemon did not start\n");
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    exit(1);
+}
+
+// sends SIGTERM, true if the daemon exited cleanly in time and removed its socket
+static bool stop_daemon(pid_t pid) {
+    kill(pid, SIGTERM);
+    for (int i = 0; i < TEST_TIMEOUT * 100; i++) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+                   access(socket_path, F_OK) != 0;
+        }
+        sleep_ms(10);
+    }
+    fprintf(stderr, "daemon_test: daemon did not stop\n");
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return false;
+}
+
+static bool read_all(int fd, void *buf, size_t n) {
+    char *p = buf;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool send_request(int fd, uint8_t kind, const char *payload, uint32_t length) {
+    char header[5];
+    header[0] = kind;
+    memcpy(header + 1, &length, sizeof(length));
+    // nothing to write after the header of an empty request, the daemon may have hung up
+    return write(fd, header, sizeof(header)) == sizeof(header) &&
+           (length == 0 || write(fd, payload, length) == length);
+}
+
+// false if the answer is malformed or does not arrive within TEST_TIMEOUT
+static bool read_response(int fd, Response *response) {
+    response->n_tokens = 0;
+    while (1) {
+        if (response->n_tokens == sizeof(response->tokens) / sizeof(DaemonToken)) return false;
+        DaemonToken *token = &response->tokens[response->n_tokens++];
+        if (!read_all(fd, token, sizeof(DaemonToken))) return false;
+        if (token->type == TOK_EOF || token->type == TOK_ERROR) break;
+    }
+
+    if (!read_all(fd, &response->n_symbols, sizeof(uint32_t))) return false;
+    for (uint32_t i = 0; i < response->n_symbols; i++) {
+        uint32_t len;
+        if (!read_all(fd, &len, sizeof(len)) || len >= sizeof(response->symbols[0]) ||
+            i >= sizeof(response->symbols) / sizeof(response->symbols[0]) ||
+            !read_all(fd, response->symbols[i], len)) {
+            return false;
+        }
+        response->symbols[i][len] = '\0';
+    }
+    return true;
+}
+
+static bool lex_inline(int fd, const char *src, Response *response) {
+    return send_request(fd, DAEMON_REQUEST_BUFFER, src, strlen(src)) &&
+           read_response(fd, response);
+}
+
+// connections that send half a request and hang up must not wedge the daemon, even when
+// they fill the request queue while the only worker is busy
+static void test_abandoned_requests() {
+    pid_t pid = start_daemon(1);
+
+    int idle[5];
+    for (int i = 0; i < 5; i++) idle[i] = connect_client();
+
+    // holds the worker: a header promising a payload that never comes
+    int blocker = connect_client();
+    uint32_t length = 16;
+    char header[5] = {DAEMON_REQUEST_BUFFER};
+    memcpy(header + 1, &length, sizeof(length));
+    CHECK(blocker >= 0 && write(blocker, header, sizeof(header)) == sizeof(header));
+    sleep_ms(100);
+
+    for (int i = 0; i < 2 * DAEMON_QUEUE_SIZE + 20; i++) {
+        int fd = connect_client();
+        CHECK(fd >= 0);
+        if (fd < 0) continue;
+        CHECK(write(fd, "\x02", 1) == 1);
+        close(fd);
+    }
+    // let the daemon queue them up before the worker is released
+    sleep_ms(200);
+    close(blocker);
+
+    for (int i = 0; i < 5; i++) {
+        Response response;
+        CHECK(idle[i] >= 0 && lex_inline(idle[i], "a + 1", &response) &&
+              response.n_tokens == 4);
+        close(idle[i]);
+    }
+
+    CHECK(stop_daemon(pid));
+}
+
+// several requests of both kinds on one connection, with their error records
+static void test_protocol(const char *sample) {
+    pid_t pid = start_daemon(2);
+    int fd = connect_client();
+    CHECK(fd >= 0);
+    Response response;
+
+    CHECK(lex_inline(fd, "x = 42;\n\"y\" x", &response));
+    CHECK(response.n_tokens == 7);
+    CHECK(response.tokens[0].type == TOK_IDENTIFIER && response.tokens[0].value == 0);
+    CHECK(response.tokens[1].type == TOK_EQUAL);
+    CHECK(response.tokens[2].type == TOK_INT && response.tokens[2].number.i == 42);
+    CHECK(response.tokens[4].type == TOK_STRING_LITERAL && response.tokens[4].value == 1);
+    CHECK(response.tokens[5].type == TOK_IDENTIFIER && response.tokens[5].value == 0);
+    CHECK(response.tokens[6].type == TOK_EOF);
+    CHECK(response.n_symbols == 2);
+    CHECK(strcmp(response.symbols[0], "x") == 0 && strcmp(response.symbols[1], "y") == 0);
+
+    // the sample lexes to 104 tokens with 12 symbols
+    CHECK(send_request(fd, DAEMON_REQUEST_PATH, sample, strlen(sample)) &&
+          read_response(fd, &response));
+    CHECK(response.n_tokens == 105 && response.tokens[104].type == TOK_EOF);
+    CHECK(response.n_symbols == 12 && strcmp(response.symbols[6], "printf") == 0);
+
+    // a lexer error ends the stream, symbols found so far still follow
+    CHECK(lex_inline(fd, "a & b", &response));
+    CHECK(response.n_tokens == 2 && response.tokens[1].type == TOK_ERROR);
+    CHECK(response.n_symbols == 1);
+
+    const char *missing = "/nonexistent/source.c";
+    CHECK(send_request(fd, DAEMON_REQUEST_PATH, missing, strlen(missing)) &&
+          read_response(fd, &response));
+    CHECK(response.n_tokens == 1 && response.tokens[0].type == TOK_ERROR &&
+          response.tokens[0].value == ENOENT && response.n_symbols == 0);
+
+    CHECK(lex_inline(fd, "int \xc0\xaf;", &response));
+    CHECK(response.n_tokens == 1 && response.tokens[0].type == TOK_ERROR &&
+          response.tokens[0].value == EILSEQ && response.n_symbols == 0);
+
+    // the connection is still usable after failed requests
+    CHECK(lex_inline(fd, "while", &response));
+    CHECK(response.n_tokens == 2 && response.tokens[0].type == TOK_KEYWORD_WHILE);
+
+    // an unknown request kind is answered with EINVAL and the connection closed
+    CHECK(send_request(fd, 9, "", 0) && read_response(fd, &response));
+    CHECK(response.n_tokens == 1 && response.tokens[0].value == EINVAL);
+    char byte;
+    CHECK(read(fd, &byte, 1) == 0);
+    close(fd);
+
+    CHECK(stop_daemon(pid));
+}
+
+// SIGTERM must not wait for clients: one idle, one in the middle of a request
+static void test_shutdown() {
+    pid_t pid = start_daemon(2);
+    int idle = connect_client();
+    int partial = connect_client();
+    CHECK(idle >= 0 && partial >= 0);
+    CHECK(write(partial, "\x02", 1) == 1);
+    sleep_ms(100);
+
+    CHECK(stop_daemon(pid));
+    close(idle);
+    close(partial);
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s main sample\n", argv[0]);
+        return 1;
+    }
+    main_path = argv[1];
+    char sample[4096];
+    if (realpath(argv[2], sample) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "/tmp/lexer-daemon-test-%d.sock", (int)getpid());
+    signal(SIGPIPE, SIG_IGN);
+
+    test_protocol(sample);
+    test_shutdown();
+    test_abandoned_requests();
+
+    if (failures > 0) {
+        fprintf(stderr, "daemon_test: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("daemon_test: passed\n");
+    return 0;
+}
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Golden output check: lexes every tests/cases/NAME.src and compares stdout, then stderr,
+# then the exit status with tests/cases/NAME.expected. NAME.args, when present, lists one set of
+# arguments per line, each run in turn on the same copy of the source (so an index written
+# by one line is read back by the next).
+#
+#   tests/run.sh [main]            run the check
+#   UPDATE=1 tests/run.sh [main]   rewrite the expected files from the current output
+
+main=$(cd "$(dirname "${1:-./main}")" && pwd)/$(basename "${1:-./main}")
+cases=$(cd "$(dirname "$0")/cases" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+total=0
+for src in "$cases"/*.src; do
+    name=$(basename "$src" .src)
+    total=$((total + 1))
+    mkdir "$work/$name"
+    cp "$src" "$work/$name/$name.src"
+
+    # sources are referred to by their bare name so error messages do not depend on paths
+    (
+        cd "$work/$name" || exit 1
+        if [ -f "$cases/$name.args" ]; then
+            while IFS= read -r args; do
+                echo "\$ main $args"
+                # word splitting of args is intended
+                "$main" $args "$name.src" 2> stderr
+                status=$?
+                cat stderr
+                echo "exit $status"
+            done < "$cases/$name.args"
+        else
+            "$main" "$name.src" 2> stderr
+            status=$?
+            cat stderr
+            echo "exit $status"
+        fi
+    ) > "$work/$name.out"
+
+    if [ -n "$UPDATE" ]; then
+        cp "$work/$name.out" "$cases/$name.expected"
+    elif ! diff -u "$cases/$name.expected" "$work/$name.out"; then
+        echo "FAIL: $name"
+        failed=$((failed + 1))
+    fi
+done
+
+if [ -n "$UPDATE" ]; then
+    echo "updated $total expected outputs"
+    exit 0
+fi
+echo "$((total - failed))/$total passed"
+[ "$failed" -eq 0 ]
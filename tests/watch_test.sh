@@ -0,0 +1,154 @@
+#!/bin/sh
+# Drives ./main --watch over a scratch tree through its stdin queries, run by make check.
+#
+#   tests/watch_test.sh [main]
+
+main=$(cd "$(dirname "${1:-./main}")" && pwd)/$(basename "${1:-./main}")
+work=$(mktemp -d)
+root="$work/tree"
+pid=
+trap 'exec 3>&-; [ -n "$pid" ] && kill -CONT "$pid" 2>/dev/null && kill "$pid" 2>/dev/null; rm -rf "$work"' EXIT
+
+failed=0
+
+fail() {
+    echo "FAIL: $1"
+    failed=$((failed + 1))
+}
+
+# check NAME ACTUAL EXPECTED
+check() {
+    if [ "$2" != "$3" ]; then
+        fail "$1"
+        printf '%s\n' "--- expected" "$3" "--- got" "$2"
+    fi
+}
+
+# prints the answer to one query, every answer ends with an empty line
+query() {
+    answers=$(($(grep -c '^$' "$work/out") + 1))
+    echo "$1" >&3
+    tries=0
+    while [ "$(grep -c '^$' "$work/out")" -lt "$answers" ]; do
+        tries=$((tries + 1))
+        if [ "$tries" -gt 200 ]; then
+            echo "FAIL: no answer to '$1'"
+            exit 1
+        fi
+        sleep 0.05
+    done
+    awk -v n="$answers" '/^$/ { seen++; next } seen == n - 1' "$work/out"
+}
+
+mkdir "$root"
+printf 'int alpha = 1;\nbeta;\n' > "$root/a.c"
+
+mkfifo "$work/in"
+"$main" --watch "$root" < "$work/in" > "$work/out" 2> "$work/err" &
+pid=$!
+exec 3> "$work/in"
+
+tries=0
+until grep -q '^watching' "$work/err"; do
+    tries=$((tries + 1))
+    if [ "$tries" -gt 200 ]; then
+        echo "FAIL: watch mode did not start"
+        cat "$work/err"
+        exit 1
+    fi
+    sleep 0.05
+done
+
+# initial lex
+check "initial tokens" "$(query "tokens $root/a.c")" "1:1 TOK_KEYWORD_INT
+1:5 TOK_IDENTIFIER: (0) alpha
+1:11 TOK_EQUAL
+1:13 TOK_INT: 1
+1:14 TOK_SEMI_COLON
+2:1 TOK_IDENTIFIER: (1) beta
+2:5 TOK_SEMI_COLON"
+
+# a rewrite is lexed again, known symbols keep their ids
+printf 'beta alpha gamma;\n' > "$root/a.c"
+check "rewritten tokens" "$(query "tokens $root/a.c")" "1:1 TOK_IDENTIFIER: (1) beta
+1:6 TOK_IDENTIFIER: (0) alpha
+1:12 TOK_IDENTIFIER: (2) gamma
+1:17 TOK_SEMI_COLON"
+check "file symbols" "$(query "symbols $root/a.c")" "1 beta
+0 alpha
+2 gamma"
+check "global symbol" "$(query "symbol 2")" "gamma"
+check "unknown symbol" "$(query "symbol 99")" "error: no symbol 99"
+
+# a new directory is watched, its files share the global symbols
+mkdir "$root/sub"
+printf 'delta alpha;\n' > "$root/sub/b.c"
+check "new directory" "$(query "tokens $root/sub/b.c")" "1:1 TOK_IDENTIFIER: (3) delta
+1:7 TOK_IDENTIFIER: (0) alpha
+1:12 TOK_SEMI_COLON"
+
+# a moved directory keeps being watched under its new name
+mv "$root/sub" "$root/moved"
+check "moved away" "$(query "tokens $root/sub/b.c")" "error: $root/sub/b.c is not watched"
+printf 'epsilon;\n' > "$root/moved/c.c"
+check "moved directory" "$(query files | sort)" "$root/a.c 4 tokens
+$root/moved/b.c 3 tokens
+$root/moved/c.c 2 tokens"
+
+# deleted files and directories are forgotten, hidden ones never show up
+rm -r "$root/moved"
+printf 'a &' > "$root/broken.c"
+printf 'hidden;\n' > "$root/.hidden.c"
+printf 'gone;\n' > "$root/gone.c"
+rm "$root/gone.c"
+check "deletions" "$(query files | sort)" "$root/a.c 4 tokens
+$root/broken.c 1 tokens (error)"
+check "unknown query" "$(query frobnicate)" "error: unknown query 'frobnicate'"
+
+# with the watcher stopped, flood its event queue past the kernel limit so that the changes
+# after the flood are dropped and only the rescan after IN_Q_OVERFLOW can find them
+limit=$(cat /proc/sys/fs/inotify/max_queued_events 2>/dev/null || echo 0)
+if [ "$limit" -gt 0 ] && [ "$limit" -le 1000000 ]; then
+    kill -STOP "$pid"
+    i=0
+    while [ "$i" -le $((limit / 2 + 100)) ]; do
+        # alternate two files, identical consecutive events are merged
+        : > "$root/.flood1"
+        : > "$root/.flood2"
+        i=$((i + 1))
+    done
+    printf 'alpha zeta;\n' > "$root/a.c"
+    rm "$root/broken.c"
+    mkdir "$root/late"
+    printf 'beta;\n' > "$root/late/d.c"
+    kill -CONT "$pid"
+
+    check "overflow rescan" "$(query files | sort)" "$root/a.c 3 tokens
+$root/late/d.c 2 tokens"
+    # whether gone.c was lexed before it went decides the new id
+    tokens=$(query "tokens $root/a.c")
+    zeta=$(printf '%s\n' "$tokens" | sed -n 's/^1:7 TOK_IDENTIFIER: (\([0-9]*\)) zeta$/\1/p')
+    check "overflow tokens" "$tokens" "1:1 TOK_IDENTIFIER: (0) alpha
+1:7 TOK_IDENTIFIER: ($zeta) zeta
+1:11 TOK_SEMI_COLON"
+    check "new global symbol" "$(query "symbol $zeta")" "zeta"
+
+    # the new directory is watched after the rescan
+    printf 'gamma;\n' > "$root/late/e.c"
+    check "watched after rescan" "$(query "tokens $root/late/e.c")" "1:1 TOK_IDENTIFIER: (2) gamma
+1:6 TOK_SEMI_COLON"
+else
+    echo "watch_test: skipping the overflow check, max_queued_events is $limit"
+fi
+
+exec 3>&-
+wait "$pid"
+status=$?
+pid=
+check "exit status" "$status" "0"
+
+if [ "$failed" -gt 0 ]; then
+    echo "watch_test: $failed checks failed"
+    exit 1
+fi
+echo "watch_test: passed"
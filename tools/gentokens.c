@@ -0,0 +1,502 @@
+// Generates the token tables and operator scanner of the lexer from src/tokens.spec
+// usage: gentokens <spec> <output dir>
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ITEMS 256
+#define MAX_NAME 64
+#define MAX_LINE 1024
+#define MAX_FIELDS 64
+
+#define GENERATED_NOTICE "// Generated by tools/gentokens.c from %s, do not edit.\n"
+
+typedef struct {
+    // full enum name, e.g. TOK_KEYWORD_AUTO
+    char name[MAX_NAME];
+    // spelling for keywords, empty for other classes
+    char keyword[MAX_NAME];
+} TokenClass;
+
+typedef struct {
+    char type[MAX_NAME];
+    char prefix[MAX_NAME];
+    char fn[MAX_NAME];
+    char names[MAX_FIELDS][MAX_NAME];
+    int n;
+} ValueGroup;
+
+typedef struct {
+    char text[MAX_NAME];
+    // index into classes, -1 for comments
+    int token_class;
+    char value[MAX_NAME];
+} Operator;
+
+typedef struct TrieNode {
+    char c;
+    int depth;
+    // index into operators, -1 if no operator ends here
+    int op;
+    bool comment;
+    struct TrieNode *children[MAX_ITEMS];
+    int n_children;
+} TrieNode;
+
+static const char *spec_path;
+static int line_number;
+
+static TokenClass classes[MAX_ITEMS];
+static int n_classes;
+static ValueGroup groups[MAX_ITEMS];
+static int n_groups;
+static Operator operators[MAX_ITEMS];
+static int n_operators;
+
+static void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", spec_path, line_number);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static void copy_name(char *dst, const char *src) {
+    if (strlen(src) >= MAX_NAME) fail("name too long: %s", src);
+    strcpy(dst, src);
+}
+
+static int find_class(const char *name) {
+    for (int i = 0; i < n_classes; i++) {
+        if (strcmp(classes[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static bool is_value(const char *name) {
+    for (int i = 0; i < n_groups; i++) {
+        for (int j = 0; j < groups[i].n; j++) {
+            char full[2 * MAX_NAME];
+            snprintf(full, sizeof(full), "%s%s", groups[i].prefix, groups[i].names[j]);
+            if (strcmp(full, name) == 0) return true;
+        }
+    }
+    return false;
+}
+
+static void add_class(const char *name, const char *keyword) {
+    if (n_classes == MAX_ITEMS) fail("too many token classes");
+    if (find_class(name) >= 0) fail("duplicate token %s", name);
+    copy_name(classes[n_classes].name, name);
+    copy_name(classes[n_classes].keyword, keyword);
+    n_classes++;
+}
+
+// strips the quotes of an operator spelling
+static void unquote(char *dst, const char *field) {
+    size_t len = strlen(field);
+    if (len < 3 || field[0] != '"' || field[len - 1] != '"') fail("expected a quoted string");
+    if (len - 2 >= MAX_NAME) fail("operator too long");
+    memcpy(dst, field + 1, len - 2);
+    dst[len - 2] = '\0';
+    for (char *c = dst; *c; c++) {
+        if (isspace((unsigned char)*c) || isalnum((unsigned char)*c) || *c == '"') {
+            fail("operators may not contain spaces, letters, digits or quotes");
+        }
+    }
+}
+
+static void add_operator(const char *text, int token_class, const char *value) {
+    if (n_operators == MAX_ITEMS) fail("too many operators");
+    Operator *op = &operators[n_operators];
+    unquote(op->text, text);
+    for (int i = 0; i < n_operators; i++) {
+        if (strcmp(operators[i].text, op->text) == 0) fail("duplicate operator \"%s\"", op->text);
+    }
+    op->token_class = token_class;
+    copy_name(op->value, value);
+    n_operators++;
+}
+
+static void parse_line(char *fields[], int n) {
+    const char *directive = fields[0];
+    char name[2 * MAX_NAME];
+
+    if (strcmp(directive, "token") == 0 && n == 2) {
+        snprintf(name, sizeof(name), "TOK_%s", fields[1]);
+        add_class(name, "");
+    } else if (strcmp(directive, "keyword") == 0 && n == 2) {
+        snprintf(name, sizeof(name), "TOK_KEYWORD_%s", fields[1]);
+        for (char *c = name; *c; c++) *c = toupper((unsigned char)*c);
+        add_class(name, fields[1]);
+    } else if (strcmp(directive, "values") == 0 && n >= 5) {
+        if (n_groups == MAX_ITEMS) fail("too many value groups");
+        ValueGroup *group = &groups[n_groups++];
+        copy_name(group->type, fields[1]);
+        copy_name(group->prefix, fields[2]);
+        copy_name(group->fn, fields[3]);
+        for (int i = 4; i < n; i++) copy_name(group->names[group->n++], fields[i]);
+    } else if (strcmp(directive, "operator") == 0 && (n == 3 || n == 4)) {
+        snprintf(name, sizeof(name), "TOK_%s", fields[2]);
+        int token_class = find_class(name);
+        if (token_class < 0) fail("unknown token %s", fields[2]);
+        if (n == 4 && !is_value(fields[3])) fail("unknown value %s", fields[3]);
+        add_operator(fields[1], token_class, n == 4 ? fields[3] : "");
+    } else if (strcmp(directive, "comment") == 0 && n == 2) {
+        add_operator(fields[1], -1, "");
+    } else {
+        fail("cannot parse '%s' directive", directive);
+    }
+}
+
+static void parse_spec(void) {
+    FILE *file = fopen(spec_path, "r");
+    if (file == NULL) {
+        perror(spec_path);
+        exit(1);
+    }
+
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        char *fields[MAX_FIELDS];
+        int n = 0;
+        for (char *field = strtok(line, " \t\r\n"); field != NULL;
+             field = strtok(NULL, " \t\r\n")) {
+            if (n == MAX_FIELDS) fail("too many fields");
+            fields[n++] = field;
+        }
+        if (n > 0) parse_line(fields, n);
+    }
+    fclose(file);
+    line_number = 0;
+}
+
+static TrieNode *new_node(char c, int depth) {
+    TrieNode *node = calloc(1, sizeof(TrieNode));
+    if (node == NULL) {
+        fprintf(stderr, "gentokens: not enough memory\n");
+        exit(1);
+    }
+    node->c = c;
+    node->depth = depth;
+    node->op = -1;
+    return node;
+}
+
+static TrieNode *build_trie(void) {
+    TrieNode *root = new_node('\0', 0);
+    for (int i = 0; i < n_operators; i++) {
+        TrieNode *node = root;
+        for (const char *c = operators[i].text; *c; c++) {
+            TrieNode *child = NULL;
+            for (int j = 0; j < node->n_children; j++) {
+                if (node->children[j]->c == *c) child = node->children[j];
+            }
+            if (child == NULL) {
+                child = new_node(*c, node->depth + 1);
+                node->children[node->n_children++] = child;
+            }
+            if (node->comment) fail("operator \"%s\" starts with a comment", operators[i].text);
+            node = child;
+        }
+        node->op = i;
+        node->comment = operators[i].token_class < 0;
+        if (node->comment && node->n_children > 0) {
+            fail("comment \"%s\" is the start of an operator", operators[i].text);
+        }
+    }
+    return root;
+}
+
+static FILE *open_output(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(file, GENERATED_NOTICE, spec_path);
+    return file;
+}
+
+static void emit_char(FILE *out, char c) {
+    if (c == '\'' || c == '\\') {
+        fprintf(out, "'\\%c'", c);
+    } else {
+        fprintf(out, "'%c'", c);
+    }
+}
+
+static void emit_token(FILE *out, const Operator *op) {
+    if (op->value[0] != '\0') {
+        fprintf(out, "(Token){%s, %s}", classes[op->token_class].name, op->value);
+    } else {
+        fprintf(out, "(Token){%s}", classes[op->token_class].name);
+    }
+}
+
+static bool needs_unread;
+
+// longest operator among the ancestors of the current node, path[0..depth) is the match so far
+static void emit_fallback(FILE *out, TrieNode *path[], int depth, const char *indent) {
+    for (int d = depth - 1; d >= 1; d--) {
+        if (path[d - 1]->op < 0) continue;
+        needs_unread = true;
+        fprintf(out, "%sunread_operator(lexer, %d);\n", indent, depth - d);
+        fprintf(out, "%sreturn ", indent);
+        emit_token(out, &operators[path[d - 1]->op]);
+        fprintf(out, ";\n");
+        return;
+    }
+
+    // prev_char leaves the lookahead in last_char, put the unmatched character back so the
+    // caller reports it (and a trailing one is not taken for EOF)
+    if (depth == 1) {
+        fprintf(out, "%slexer->last_char = ", indent);
+        emit_char(out, path[0]->c);
+        fprintf(out, ";\n%sbreak;\n", indent);
+        return;
+    }
+    needs_unread = true;
+    fprintf(out, "%sunread_operator(lexer, %d);\n", indent, depth - 1);
+    fprintf(out, "%sreturn (Token){TOK_ERROR};\n", indent);
+}
+
+static void emit_node(FILE *out, TrieNode *node, TrieNode *path[]) {
+    char indent[256];
+    int width = 4 + node->depth * 8;
+    memset(indent, ' ', width);
+    indent[width] = '\0';
+
+    path[node->depth - 1] = node;
+    fprintf(out, "%.*scase ", width - 4, indent);
+    emit_char(out, node->c);
+    fprintf(out, ": {\n");
+
+    if (node->comment) {
+        fprintf(out, "%sdo {\n%s    next_char(lexer);\n", indent, indent);
+        fprintf(out, "%s} while (lexer->last_char != '\\n' && lexer->last_char != EOF);\n",
+                indent);
+        fprintf(out, "%sreturn get_token(lexer);\n", indent);
+        fprintf(out, "%.*s}\n", width - 4, indent);
+        return;
+    }
+
+    if (node->n_children > 0) {
+        fprintf(out, "%snext_char(lexer);\n", indent);
+        fprintf(out, "%sswitch (lexer->last_char) {\n", indent);
+        for (int i = 0; i < node->n_children; i++) emit_node(out, node->children[i], path);
+        fprintf(out, "%s}\n", indent);
+        fprintf(out, "%sprev_char(lexer);\n", indent);
+    }
+
+    if (node->op >= 0) {
+        fprintf(out, "%sreturn ", indent);
+        emit_token(out, &operators[node->op]);
+        fprintf(out, ";\n");
+    } else {
+        emit_fallback(out, path, node->depth, indent);
+    }
+    fprintf(out, "%.*s}\n", width - 4, indent);
+}
+
+static void emit_scanner(const char *dir) {
+    TrieNode *root = build_trie();
+    TrieNode *path[MAX_NAME];
+
+    // the body is generated first, it decides whether the unread helper is needed
+    char *body;
+    size_t body_len;
+    FILE *out = open_memstream(&body, &body_len);
+    for (int i = 0; i < root->n_children; i++) emit_node(out, root->children[i], path);
+    fclose(out);
+
+    out = open_output(dir, "scanner.gen.inc");
+    fprintf(out, "// included by lexer.c, uses its next_char/prev_char\n\n");
+    if (needs_unread) {
+        fprintf(out,
+                "// steps back over n characters of an operator, they never contain newlines\n");
+        fprintf(out, "static void unread_operator(Lexer *lexer, int n) {\n");
+        fprintf(out, "    lexer->pos -= n;\n");
+        fprintf(out, "    lexer->col -= n;\n");
+        fprintf(out, "    lexer->last_char = (uint8_t)lexer->src[lexer->pos - 1];\n");
+        fprintf(out, "}\n\n");
+    }
+    fprintf(out, "// matches the operator or comment starting at last_char, TOK_EOF at the end\n");
+    fprintf(out, "// of the source, TOK_ERROR if there is none\n");
+    fprintf(out, "static Token scan_operator(Lexer *lexer) {\n");
+    fprintf(out, "    switch (lexer->last_char) {\n");
+    fprintf(out, "        case EOF: {\n");
+    fprintf(out, "            return (Token){TOK_EOF};\n");
+    fprintf(out, "        }\n");
+    fwrite(body, 1, body_len, out);
+    fprintf(out, "    }\n");
+    fprintf(out, "    return (Token){TOK_ERROR};\n");
+    fprintf(out, "}\n");
+    fclose(out);
+    free(body);
+}
+
+static void emit_header(const char *dir) {
+    FILE *out = open_output(dir, "tokens.gen.h");
+    fprintf(out, "#ifndef __TOKENS_GEN_H__\n#define __TOKENS_GEN_H__\n\n");
+    fprintf(out, "#include <stddef.h>\n\n");
+
+    fprintf(out, "typedef enum {\n    TOK_ERROR = -1,\n");
+    for (int i = 0; i < n_classes; i++) {
+        fprintf(out, "    %s%s\n", classes[i].name, i + 1 < n_classes ? "," : "");
+    }
+    fprintf(out, "} TokenType;\n");
+
+    for (int i = 0; i < n_groups; i++) {
+        fprintf(out, "\ntypedef enum {\n");
+        for (int j = 0; j < groups[i].n; j++) {
+            fprintf(out, "    %s%s%s\n", groups[i].prefix, groups[i].names[j],
+                    j + 1 < groups[i].n ? "," : "");
+        }
+        fprintf(out, "} %s;\n", groups[i].type);
+    }
+
+    fprintf(out, "\nconst char *tok_to_str(TokenType tok);\n");
+    for (int i = 0; i < n_groups; i++) {
+        fprintf(out, "const char *%s(%s value);\n", groups[i].fn, groups[i].type);
+    }
+
+    fprintf(out, "\n/**\n * keyword class of id[0..len), TOK_ERROR if it is not a keyword\n */\n");
+    fprintf(out, "TokenType keyword_lookup(const char *id, size_t len);\n");
+    fprintf(out, "\n#endif\n");
+    fclose(out);
+}
+
+static uint32_t keyword_hash(const char *s, size_t len, uint32_t seed, uint32_t mult) {
+    uint32_t h = seed;
+    for (size_t i = 0; i < len; i++) h = h * mult + (uint8_t)s[i];
+    return h ^ (h >> 16);
+}
+
+// looks for a multiplier that sends every keyword to its own slot of a power of two table
+static bool find_perfect_hash(int *slots, uint32_t size, uint32_t *mult) {
+    for (uint32_t candidate = 3; candidate < 1000000; candidate += 2) {
+        for (uint32_t i = 0; i < size; i++) slots[i] = -1;
+
+        bool perfect = true;
+        for (int i = 0; i < n_classes && perfect; i++) {
+            if (classes[i].keyword[0] == '\0') continue;
+            uint32_t slot = keyword_hash(classes[i].keyword, strlen(classes[i].keyword), 0,
+                                         candidate) & (size - 1);
+            if (slots[slot] >= 0) perfect = false;
+            slots[slot] = i;
+        }
+
+        if (perfect) {
+            *mult = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void emit_tables(const char *dir) {
+    FILE *out = open_output(dir, "tokens.gen.c");
+    fprintf(out, "#include \"tokens.gen.h\"\n\n#include <stdint.h>\n#include <string.h>\n\n");
+
+    fprintf(out, "static const char *const token_names[] = {\n    \"TOK_ERROR\",\n");
+    for (int i = 0; i < n_classes; i++) fprintf(out, "    \"%s\",\n", classes[i].name);
+    fprintf(out, "};\n\n");
+    fprintf(out, "const char *tok_to_str(TokenType tok) {\n");
+    fprintf(out, "    if (tok < TOK_ERROR || tok > %s) return \"<unknown>\";\n",
+            classes[n_classes - 1].name);
+    fprintf(out, "    return token_names[tok + 1];\n}\n");
+
+    for (int i = 0; i < n_groups; i++) {
+        const ValueGroup *group = &groups[i];
+        fprintf(out, "\nstatic const char *const %s_names[] = {\n", group->fn);
+        for (int j = 0; j < group->n; j++) {
+            fprintf(out, "    \"%s%s\",\n", group->prefix, group->names[j]);
+        }
+        fprintf(out, "};\n\n");
+        fprintf(out, "const char *%s(%s value) {\n", group->fn, group->type);
+        fprintf(out, "    if (value < 0 || value >= %d) return \"<unknown>\";\n", group->n);
+        fprintf(out, "    return %s_names[value];\n}\n", group->fn);
+    }
+
+    int n_keywords = 0;
+    size_t min_len = SIZE_MAX;
+    size_t max_len = 0;
+    for (int i = 0; i < n_classes; i++) {
+        size_t len = strlen(classes[i].keyword);
+        if (len == 0) continue;
+        n_keywords++;
+        if (len < min_len) min_len = len;
+        if (len > max_len) max_len = len;
+    }
+
+    uint32_t size = 1;
+    while (size < n_keywords) size *= 2;
+
+    static int slots[1 << 16];
+    uint32_t mult = 0;
+    while (n_keywords > 0 && !find_perfect_hash(slots, size, &mult)) {
+        size *= 2;
+        if (size > sizeof(slots) / sizeof(slots[0])) {
+            fprintf(stderr, "%s: could not find a perfect hash for the keywords\n", spec_path);
+            exit(1);
+        }
+    }
+
+    fprintf(out, "\ntypedef struct {\n    const char *str;\n    size_t len;\n");
+    fprintf(out, "    TokenType token_class;\n} KeywordSlot;\n\n");
+    fprintf(out, "// perfect hash table, every keyword hashes to its own slot\n");
+    fprintf(out, "static const KeywordSlot keyword_slots[%u] = {\n", size);
+    for (uint32_t i = 0; n_keywords > 0 && i < size; i++) {
+        if (slots[i] < 0) continue;
+        const TokenClass *keyword = &classes[slots[i]];
+        fprintf(out, "    [%u] = {\"%s\", %zu, %s},\n", i, keyword->keyword,
+                strlen(keyword->keyword), keyword->name);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "TokenType keyword_lookup(const char *id, size_t len) {\n");
+    if (n_keywords == 0) {
+        fprintf(out, "    return TOK_ERROR;\n}\n");
+        fclose(out);
+        return;
+    }
+    fprintf(out, "    if (len < %zu || len > %zu) return TOK_ERROR;\n\n", min_len, max_len);
+    fprintf(out, "    uint32_t h = 0;\n");
+    fprintf(out, "    for (size_t i = 0; i < len; i++) h = h * %uu + (uint8_t)id[i];\n", mult);
+    fprintf(out, "    const KeywordSlot *slot = &keyword_slots[(h ^ (h >> 16)) & %uu];\n",
+            size - 1);
+    fprintf(out,
+            "    if (slot->len != len || memcmp(slot->str, id, len) != 0) return TOK_ERROR;\n");
+    fprintf(out, "    return slot->token_class;\n}\n");
+    fclose(out);
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s spec outdir\n", argv[0]);
+        return 1;
+    }
+
+    spec_path = argv[1];
+    parse_spec();
+    if (n_classes == 0) fail("no tokens declared");
+
+    emit_header(argv[2]);
+    emit_tables(argv[2]);
+    emit_scanner(argv[2]);
+    return 0;
+}